@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "results.hpp"
+
+/**
+ * Collects the binary result records (results.csm) of many test stations at
+ * once, into an append-only ResultLog, and answers lot queries on such a log.
+ *
+ *   collector [-b BAUD] LOG [LOT=]SOURCE...
+ *   collector -q LOG [LOT...]
+ *
+ * A SOURCE is a serial device (configured raw 8N1 at BAUD, default 1000000),
+ * a FIFO, a simavr UART pty or a recorded stream. All sources are served from
+ * a single poll() loop; collecting ends when every source has reached end of
+ * file, or on SIGINT/SIGTERM. A FIFO never ends: when its writer closes it,
+ * the chip under test is logged as incomplete and the FIFO is opened again,
+ * for the next writer (e.g. a restarted simavr).
+ */
+
+namespace /* anonymous */ {
+
+	volatile std::sig_atomic_t stop_requested = 0;
+
+	void request_stop(int) {
+		stop_requested = 1;
+	}
+
+
+	std::uint64_t now_us() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()
+		).count();
+	}
+
+
+	template<std::size_t N>
+	void copy_name(char (&dst)[N], const std::string& src) {
+		std::memset(dst, 0, N);
+		std::memcpy(dst, src.data(), std::min(src.size(), N - 1));
+	}
+
+
+	speed_t baud_constant(unsigned long baud) {
+		switch(baud) {
+			case    9600: return B9600;
+			case   19200: return B19200;
+			case   38400: return B38400;
+			case   57600: return B57600;
+			case  115200: return B115200;
+			case  230400: return B230400;
+#ifdef B500000
+			case  500000: return B500000;
+#endif
+#ifdef B1000000
+			case 1000000: return B1000000;
+#endif
+#ifdef B2000000
+			case 2000000: return B2000000;
+#endif
+		}
+		throw std::runtime_error("unsupported baud rate " + std::to_string(baud));
+	}
+
+
+	/**
+	 * One input stream, with the chip currently being tested on it.
+	 */
+	class Station {
+		public:
+			Station(const std::string& arg, unsigned long baud)
+			: m_fd{-1}
+			, m_fifo{false}
+			{
+				const std::size_t eq = arg.find('=');
+				m_lot  = eq == std::string::npos ? "default" : arg.substr(0, eq);
+				m_path = eq == std::string::npos ? arg : arg.substr(eq + 1);
+				if(m_lot.empty() || m_lot.size() >= sizeof(ChipSummary::lot)) {
+					throw std::runtime_error("invalid lot name '" + m_lot + "' (1..15 characters)");
+				}
+				open();
+				struct stat st{};
+				m_fifo = ::fstat(m_fd, &st) == 0 && S_ISFIFO(st.st_mode);
+				if(::isatty(m_fd)) {
+					termios tio{};
+					if(::tcgetattr(m_fd, &tio) != 0) {
+						throw std::runtime_error("error configuring '" + m_path + "': " + std::strerror(errno));
+					}
+					::cfmakeraw(&tio);
+					tio.c_cflag |= CLOCAL | CREAD;
+					tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+					::cfsetispeed(&tio, baud_constant(baud));
+					::cfsetospeed(&tio, baud_constant(baud));
+					if(::tcsetattr(m_fd, TCSANOW, &tio) != 0) {
+						throw std::runtime_error("error configuring '" + m_path + "': " + std::strerror(errno));
+					}
+				}
+				const std::size_t slash = m_path.find_last_of('/');
+				m_name = slash == std::string::npos ? m_path : m_path.substr(slash + 1);
+			}
+
+			~Station() {
+				close();
+			}
+
+			Station(const Station&) = delete;
+			Station& operator=(const Station&) = delete;
+
+			int fd() const {
+				return m_fd;
+			}
+
+			const std::string& path() const {
+				return m_path;
+			}
+
+			/**
+			 * Reads what is available and handles all complete records in it.
+			 * Returns false at end of file, which a FIFO does not have.
+			 */
+			bool service(ResultLog& log) {
+				const ssize_t n = ::read(m_fd, m_decoder.read_buffer(), m_decoder.read_space());
+				if(n < 0) {
+					if(errno == EAGAIN || errno == EINTR) {
+						return true;
+					}
+					std::cerr << m_path << ": " << std::strerror(errno) << "\n";
+					return false;
+				}
+				if(n == 0 && m_fifo) {
+					// The writer is gone; without a writer a new read end
+					// doesn't poll readable until the next one opens it
+					if(m_chip) {
+						end_chip(log, now_us());
+					}
+					::close(m_fd);
+					m_fd = -1;
+					open();
+					return true;
+				}
+				if(n == 0) {
+					return false;
+				}
+				const std::uint64_t time_us = now_us();
+				m_decoder.commit(n, [&](const ResultRecord& record) {
+					handle(log, time_us, record);
+				});
+				return true;
+			}
+
+			/**
+			 * Ends the stream, a chip still under test is logged as incomplete.
+			 */
+			void close(ResultLog* log = nullptr) {
+				if(log && m_chip) {
+					end_chip(*log, now_us());
+				}
+				if(m_fd >= 0) {
+					::close(m_fd);
+					m_fd = -1;
+				}
+			}
+
+			void report(std::ostream& out) const {
+				out << m_path << ": " << m_chips << " chips, "
+				    << m_decoder.bad_frames() << " bad frames, "
+				    << m_decoder.skipped_bytes() << " bytes skipped\n";
+			}
+
+		private:
+			void open() {
+				// Without O_NONBLOCK, opening a FIFO waits for a writer
+				m_fd = ::open(m_path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+				if(m_fd < 0) {
+					throw std::runtime_error("error opening '" + m_path + "': " + std::strerror(errno));
+				}
+			}
+
+			void handle(ResultLog& log, std::uint64_t time_us, const ResultRecord& record) {
+				// The firmware always starts a run with test 1
+				if(!m_chip || (record.type() == ResultType::test_start && record.u8(0) == 1)) {
+					if(m_chip) {
+						end_chip(log, time_us);
+					}
+					begin_chip(log, time_us);
+				}
+				log.append(time_us, m_chip->chip, record);
+
+				ChipSummary& chip = *m_chip;
+				switch(record.type()) {
+					case ResultType::test_start:
+						chip.socket = record.u8(1);
+						break;
+					case ResultType::test_end:
+						chip.tests_run = std::max(chip.tests_run, record.u8(0));
+						if(record.u8(2)) {
+							++chip.tests_failed;
+							if(record.u8(0) >= 1 && record.u8(0) <= 32) {
+								chip.failed_tests |= std::uint32_t(1) << (record.u8(0) - 1);
+							}
+						}
+						break;
+					case ResultType::cycles:
+						// Full-memory passes are only logged, they are part of a test
+						if(record.u8(0) == result_cycles_refresh) {
+							chip.refresh_cycles = record.u32(1);
+						}
+						else if(record.u8(0) < result_cycles_fill_pass) {
+							chip.cycles += record.u32(1);
+						}
+						break;
+					case ResultType::failure:
+						chip.socket = record.u8(0);
+						chip.failure_classes |= classify_failure(record.u8(3), record.u8(4));
+						if(chip.failures != 0xffff) {
+							++chip.failures;
+						}
+						break;
+					case ResultType::socket_status:
+						// The firmware's own count is authoritative
+						chip.socket       = record.u8(0);
+						chip.tests_run    = record.u8(1);
+						chip.tests_failed = record.u8(2);
+						chip.complete     = 1;
+						end_chip(log, time_us);
+						break;
+				}
+			}
+
+			void begin_chip(ResultLog& log, std::uint64_t time_us) {
+				m_chip.emplace();
+				ChipSummary& chip = *m_chip;
+				std::memset(&chip, 0, sizeof(chip));
+				copy_name(chip.lot, m_lot);
+				copy_name(chip.station, m_name);
+				chip.chip          = log.next_chip();
+				chip.log_offset    = log.size();
+				chip.start_time_us = time_us;
+			}
+
+			void end_chip(ResultLog& log, std::uint64_t time_us) {
+				m_chip->end_time_us = time_us;
+				log.append(*m_chip);
+				m_chip.reset();
+				++m_chips;
+			}
+
+			int                        m_fd;
+			bool                       m_fifo;
+			std::string                m_lot;
+			std::string                m_path;
+			std::string                m_name;
+			ResultDecoder              m_decoder;
+			std::optional<ChipSummary> m_chip;
+			std::size_t                m_chips{};
+	};
+
+
+	int collect(const std::string& log_name, const std::vector<std::string>& sources, unsigned long baud) {
+		ResultLog log{log_name};
+		std::vector<std::unique_ptr<Station>> stations;
+		for(const auto& source : sources) {
+			stations.emplace_back(std::make_unique<Station>(source, baud));
+		}
+
+		struct sigaction action{};
+		action.sa_handler = request_stop;
+		// No SA_RESTART, poll() has to return so the loop can end
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+
+		std::vector<pollfd> fds;
+		std::vector<Station*> open;
+		for(const auto& station : stations) {
+			open.push_back(station.get());
+		}
+		while(!open.empty() && !stop_requested) {
+			fds.clear();
+			for(const Station* station : open) {
+				fds.push_back({station->fd(), POLLIN, 0});
+			}
+			if(::poll(fds.data(), fds.size(), -1) < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				throw std::runtime_error(std::string("poll: ") + std::strerror(errno));
+			}
+			for(std::size_t i = 0; i < fds.size(); ++i) {
+				if(!fds[i].revents) {
+					continue;
+				}
+				// POLLHUP with data still pending reads the data first
+				if(!open[i]->service(log)) {
+					open[i]->close(&log);
+					open[i] = nullptr;
+				}
+			}
+			open.erase(std::remove(open.begin(), open.end(), nullptr), open.end());
+			log.flush();
+		}
+
+		for(const auto& station : stations) {
+			station->close(&log);
+			station->report(std::cerr);
+		}
+		log.flush();
+		return 0;
+	}
+
+
+	struct LotSummary {
+		std::size_t chips{};
+		std::size_t passed{};
+		std::size_t failed{};
+		std::size_t incomplete{};
+		std::size_t failure_classes[failure_class_count]{};
+	};
+
+
+	int query(const std::string& log_name, const std::vector<std::string>& lots) {
+		const std::vector<ChipSummary> index = ResultLog::read_index(log_name);
+		const auto selected = [&](const ChipSummary& chip) {
+			return lots.empty() || std::find(lots.begin(), lots.end(), chip.lot) != lots.end();
+		};
+
+		std::map<std::string, LotSummary> by_lot;
+		for(const ChipSummary& chip : index) {
+			if(!selected(chip)) {
+				continue;
+			}
+			LotSummary& lot = by_lot[chip.lot];
+			++lot.chips;
+			if(!chip.complete) {
+				++lot.incomplete;
+			}
+			else if(chip.passed()) {
+				++lot.passed;
+			}
+			else {
+				++lot.failed;
+			}
+			for(std::size_t bit = 0; bit < failure_class_count; ++bit) {
+				lot.failure_classes[bit] += (chip.failure_classes >> bit) & 1;
+			}
+		}
+
+		std::cout << std::left << std::setw(16) << "lot"
+		          << std::right << std::setw(8) << "chips" << std::setw(8) << "pass" << std::setw(8) << "fail" << std::setw(8) << "incompl";
+		for(std::size_t bit = 0; bit < failure_class_count; ++bit) {
+			std::cout << std::setw(12) << failure_class_name(bit);
+		}
+		std::cout << "\n";
+		for(const auto& [name, lot] : by_lot) {
+			std::cout << std::left << std::setw(16) << name
+			          << std::right << std::setw(8) << lot.chips << std::setw(8) << lot.passed << std::setw(8) << lot.failed << std::setw(8) << lot.incomplete;
+			for(std::size_t bit = 0; bit < failure_class_count; ++bit) {
+				std::cout << std::setw(12) << lot.failure_classes[bit];
+			}
+			std::cout << "\n";
+		}
+
+		// Individual chips only when asked about specific lots
+		if(!lots.empty()) {
+			std::cout << "\n";
+			for(const ChipSummary& chip : index) {
+				if(!selected(chip)) {
+					continue;
+				}
+				std::cout << std::left << std::setw(16) << chip.lot
+				          << " chip " << std::right << std::setw(6) << chip.chip
+				          << "  " << std::left << std::setw(16) << chip.station
+				          << " socket " << unsigned(chip.socket)
+				          << "  " << (!chip.complete ? "INCOMPLETE" : chip.passed() ? "PASS" : "FAIL")
+				          << "  " << unsigned(chip.tests_failed) << "/" << unsigned(chip.tests_run) << " tests failed"
+				          << ", " << chip.failures << " failures"
+				          << ", " << chip.cycles << " cycles (" << chip.refresh_cycles << " refresh)"
+				          << ", log offset " << chip.log_offset;
+				for(std::size_t bit = 0; bit < failure_class_count; ++bit) {
+					if((chip.failure_classes >> bit) & 1) {
+						std::cout << " " << failure_class_name(bit);
+					}
+				}
+				std::cout << "\n";
+			}
+		}
+		return 0;
+	}
+
+
+	void usage(const char* self) {
+		std::cerr << "usage: " << self << " [-b BAUD] LOG [LOT=]SOURCE...\n"
+		          << "       " << self << " -q LOG [LOT...]\n";
+	}
+
+} /* anonymous */
+
+
+int main(const int argc, const char* argv[]) try {
+	unsigned long baud = 1000000;
+	bool          query_mode = false;
+	int           i = 1;
+	for(; i < argc && argv[i][0] == '-'; ++i) {
+		const std::string opt = argv[i];
+		if(opt == "-q") {
+			query_mode = true;
+		}
+		else if(opt == "-b" && i + 1 < argc) {
+			baud = std::stoul(argv[++i]);
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(i >= argc || (!query_mode && i + 1 >= argc)) {
+		usage(argv[0]);
+		return 1;
+	}
+	const std::string log_name = argv[i++];
+	const std::vector<std::string> args(argv + i, argv + argc);
+	return query_mode ? query(log_name, args) : collect(log_name, args, baud);
+}
+catch(const std::exception& e) {
+	std::cerr << "Fatal error: " << e.what() << std::endl;
+	return 1;
+}
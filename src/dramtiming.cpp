@@ -0,0 +1,515 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <queue>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util.hpp"
+
+/**
+ * Static verifier for the DRAM timing of the m4164 driver.
+ *
+ *   dramtiming [-f F_CPU] [-g SPEED_GRADE] LISTING
+ *
+ * Reads the avra listing of the firmware, and follows every path from each
+ * control line change to the events it constrains, checking the shortest
+ * such path against the timing parameters of the chosen speed grade.
+ *
+ * Events are:
+ *  - writes to PORTC (out, sbi, cbi). As the masks of the control lines are
+ *    only known at run time, every such write must say which lines it changes
+ *    with tags in its comment: @RAS / @CAS / @WE for asserting (pulling low),
+ *    @~RAS / @~CAS / @~WE for de-asserting a line.
+ *  - writes to PORTD (address lines).
+ *  - reads of PINC (in, sbic, sbis).
+ *
+ * A write takes effect at the end of the instruction. A read samples the pin
+ * half a cycle before the instruction starts (the synchroniser latches it on
+ * the falling clock edge before the PINx register is clocked).
+ *
+ * Paths are followed through branches and skips with their taken/not taken
+ * cycle counts. Called routines are not followed; a call is counted as the
+ * call and a bare ret. A path leaving a routine (ret, reti, ijmp) ends there,
+ * and counts as the earliest the next routine could be entered: after the
+ * return and another call. All constraints are minimums, so a longer path
+ * (e.g. an interrupt, or a loop iteration) can only add margin.
+ */
+
+namespace /* anonymous */ {
+
+	enum Signal : unsigned {
+		signal_ras = 1<<0,
+		signal_cas = 1<<1,
+		signal_we  = 1<<2,
+	};
+
+	enum class Event {
+		ras_assert,
+		ras_deassert,
+		cas_assert,
+		cas_deassert,
+		address,
+		read,
+	};
+
+
+	struct Instruction {
+		std::size_t              address{}; // in words
+		std::size_t              line{};    // in the listing
+		std::string              mnemonic;
+		std::vector<std::string> operands;
+		std::string              comment;
+		std::vector<std::uint16_t> opcode;
+		std::size_t              words{};
+		unsigned                 cycles{};
+		unsigned                 asserts{};
+		unsigned                 deasserts{};
+		bool                     control_write{};
+		bool                     address_write{};
+		bool                     read{};
+
+		bool is(Event event) const {
+			switch(event) {
+				case Event::ras_assert:   return asserts   & signal_ras;
+				case Event::ras_deassert: return deasserts & signal_ras;
+				case Event::cas_assert:   return asserts   & signal_cas;
+				case Event::cas_deassert: return deasserts & signal_cas;
+				case Event::address:      return address_write;
+				case Event::read:         return read;
+			}
+			return false;
+		}
+	};
+
+
+	/**
+	 * One timing parameter: the time from a `from` event to the first `to`
+	 * event after it, unless an `until` event comes first.
+	 */
+	struct Constraint {
+		const char* name;
+		const char* description;
+		Event       from;
+		Event       to;
+		const Event* until;
+	};
+
+	const Event cas_deassert = Event::cas_deassert;
+	const Event ras_deassert = Event::ras_deassert;
+
+	const Constraint constraints[] = {
+		{ "Tras", "RAS pulse width",         Event::ras_assert,   Event::ras_deassert, nullptr       },
+		{ "Trp",  "RAS precharge time",      Event::ras_deassert, Event::ras_assert,   nullptr       },
+		{ "Tcas", "CAS pulse width",         Event::cas_assert,   Event::cas_deassert, nullptr       },
+		{ "Tcp",  "CAS precharge time",      Event::cas_deassert, Event::cas_assert,   nullptr       },
+		{ "Trcd", "RAS to CAS delay",        Event::ras_assert,   Event::cas_assert,   &ras_deassert },
+		{ "Tcac", "access time from CAS",    Event::cas_assert,   Event::read,         &cas_deassert },
+		{ "Trah", "row address hold time",   Event::ras_assert,   Event::address,      nullptr       },
+		{ "Tcah", "column address hold time",Event::cas_assert,   Event::address,      nullptr       },
+	};
+	constexpr std::size_t constraint_count = sizeof(constraints) / sizeof(constraints[0]);
+
+	/**
+	 * Minimum times in ns, in the order of `constraints`. Trcd is only the
+	 * minimum; its maximum is not a hard limit (longer only delays access).
+	 */
+	const std::map<std::string, std::array<double, constraint_count>> speed_grades = {
+		//         Tras  Trp  Tcas  Tcp Trcd  Tcac Trah Tcah
+		{ "15", { 150, 100,   75,  60,  25,   75,  15,  20 } },
+		{ "20", { 200, 120,  100,  80,  30,  100,  20,  25 } },
+	};
+
+
+	std::string lower(std::string s) {
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+		return s;
+	}
+
+	std::string trim(const std::string& s) {
+		const std::size_t begin = s.find_first_not_of(" \t");
+		const std::size_t end   = s.find_last_not_of(" \t\r");
+		return begin == std::string::npos ? "" : s.substr(begin, end - begin + 1);
+	}
+
+	bool is_io(const std::string& operand, const char* name, unsigned address) {
+		const std::string op = lower(operand);
+		if(op == lower(name)) {
+			return true;
+		}
+		try {
+			std::size_t used = 0;
+			const std::string digits = op.rfind("0x", 0) == 0 ? op.substr(2) : op[0] == '$' ? op.substr(1) : op;
+			const int base = digits.size() != op.size() ? 16 : 10;
+			return std::stoul(digits, &used, base) == address && used == digits.size();
+		}
+		catch(const std::exception&) {
+			return false;
+		}
+	}
+
+
+	unsigned instruction_cycles(const std::string& mnemonic) {
+		static const std::map<std::string, unsigned> cycles = {
+			{"adiw", 2}, {"sbiw", 2},
+			{"mul", 2}, {"muls", 2}, {"mulsu", 2}, {"fmul", 2}, {"fmuls", 2}, {"fmulsu", 2},
+			{"ld", 2}, {"ldd", 2}, {"lds", 2}, {"st", 2}, {"std", 2}, {"sts", 2},
+			{"push", 2}, {"pop", 2}, {"sbi", 2}, {"cbi", 2},
+			{"lpm", 3}, {"elpm", 3},
+			{"rjmp", 2}, {"ijmp", 2}, {"jmp", 3},
+			{"rcall", 3}, {"icall", 3}, {"call", 4},
+			{"ret", 4}, {"reti", 4},
+		};
+		const auto it = cycles.find(mnemonic);
+		return it == cycles.end() ? 1 : it->second;
+	}
+
+	std::size_t instruction_words(const std::string& mnemonic) {
+		return mnemonic == "lds" || mnemonic == "sts" || mnemonic == "jmp" || mnemonic == "call" ? 2 : 1;
+	}
+
+
+	class Listing {
+		public:
+			explicit Listing(const std::string& file_name) {
+				std::ifstream input{file_name};
+				if(!input) {
+					throw std::runtime_error("error opening file '" + file_name + "'.");
+				}
+				// C:000034 e0f0      ldi zh, 0x00 ; comment
+				const std::regex code_line{R"(^C:([0-9a-fA-F]+)((?:\s+[0-9a-fA-F]{4})+)\s+(\S.*)$)"};
+				const std::regex label_line{R"(^\s*([A-Za-z_][A-Za-z0-9_]*):(.*)$)"};
+				const std::regex tag{R"(@\s*(~?)\s*(RAS|CAS|WE)\b)"};
+
+				std::vector<std::string> pending_labels;
+				std::string line;
+				std::size_t line_number = 0;
+				while(std::getline(input, line)) {
+					++line_number;
+					std::smatch match;
+					const bool is_code = std::regex_match(line, match, code_line);
+					if(!is_code && line.rfind("C:", 0) == 0) {
+						continue;
+					}
+					std::string text = is_code ? match[3].str() : line;
+					std::smatch label;
+					while(std::regex_match(text, label, label_line)) {
+						pending_labels.push_back(label[1]);
+						text = label[2];
+					}
+					if(!is_code) {
+						continue;
+					}
+
+					Instruction instruction;
+					instruction.address = std::stoul(match[1], nullptr, 16);
+					instruction.line    = line_number;
+					std::istringstream opcodes{match[2]};
+					std::string word;
+					while(opcodes >> word) {
+						instruction.opcode.push_back(std::stoul(word, nullptr, 16));
+					}
+					const std::size_t semicolon = text.find(';');
+					if(semicolon != std::string::npos) {
+						instruction.comment = text.substr(semicolon + 1);
+						text = text.substr(0, semicolon);
+					}
+					text = trim(text);
+					if(text.empty() || text[0] == '.') {
+						// data (.db/.dw) in the code segment
+						continue;
+					}
+					const std::size_t space = text.find_first_of(" \t");
+					instruction.mnemonic = lower(text.substr(0, space));
+					if(space != std::string::npos) {
+						std::istringstream operands{text.substr(space)};
+						std::string operand;
+						while(std::getline(operands, operand, ',')) {
+							instruction.operands.push_back(trim(operand));
+						}
+					}
+					instruction.words  = instruction_words(instruction.mnemonic);
+					instruction.cycles = instruction_cycles(instruction.mnemonic);
+					if(instruction.opcode.size() < instruction.words) {
+						throw std::runtime_error("listing line " + std::to_string(line_number) + ": missing opcode word");
+					}
+
+					const auto io_operand = [&]() -> std::string {
+						if(instruction.mnemonic == "in") {
+							return instruction.operands.size() > 1 ? instruction.operands[1] : "";
+						}
+						return instruction.operands.empty() ? "" : instruction.operands[0];
+					}();
+					const std::string& m = instruction.mnemonic;
+					if(m == "out" || m == "sbi" || m == "cbi") {
+						instruction.control_write = is_io(io_operand, "PORTC", 0x08);
+						instruction.address_write = is_io(io_operand, "PORTD", 0x0b);
+					}
+					if(m == "in" || m == "sbic" || m == "sbis") {
+						instruction.read = is_io(io_operand, "PINC", 0x06);
+					}
+					for(std::sregex_iterator it{instruction.comment.begin(), instruction.comment.end(), tag}, end; it != end; ++it) {
+						const unsigned signal = (*it)[2] == "RAS" ? signal_ras : (*it)[2] == "CAS" ? signal_cas : signal_we;
+						((*it)[1].length() ? instruction.deasserts : instruction.asserts) |= signal;
+					}
+					if((instruction.asserts || instruction.deasserts) && !instruction.control_write) {
+						throw std::runtime_error("listing line " + std::to_string(line_number) + ": signal tags on an instruction that does not write PORTC");
+					}
+					if(instruction.control_write && !instruction.asserts && !instruction.deasserts) {
+						throw std::runtime_error("listing line " + std::to_string(line_number) + ": write to PORTC without signal tags (@RAS, @~CAS, ...)");
+					}
+
+					for(const auto& name : pending_labels) {
+						m_labels.emplace(instruction.address, name);
+					}
+					pending_labels.clear();
+					m_by_address[instruction.address] = m_instructions.size();
+					m_instructions.push_back(std::move(instruction));
+				}
+			}
+
+			const std::vector<Instruction>& instructions() const {
+				return m_instructions;
+			}
+
+			/**
+			 * Index of the instruction at a word address, or npos.
+			 */
+			std::size_t at(std::size_t address) const {
+				const auto it = m_by_address.find(address);
+				return it == m_by_address.end() ? npos : it->second;
+			}
+
+			std::string location(const Instruction& instruction) const {
+				std::stringstream ss;
+				auto it = m_labels.upper_bound(instruction.address);
+				if(it != m_labels.begin()) {
+					--it;
+					ss << it->second;
+					if(instruction.address != it->first) {
+						ss << "+" << (instruction.address - it->first);
+					}
+				}
+				else {
+					ss << to_hex<std::uint16_t>(instruction.address);
+				}
+				ss << " (line " << instruction.line << ")";
+				return ss.str();
+			}
+
+			static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+		private:
+			std::vector<Instruction>           m_instructions;
+			std::map<std::size_t, std::size_t> m_by_address;
+			std::multimap<std::size_t, std::string> m_labels;
+	};
+
+
+	struct Edge {
+		std::size_t to;     // Listing::npos when leaving the routine
+		unsigned    cycles; // of the instruction, when taking this edge
+	};
+
+	/**
+	 * Successors of an instruction, with the cycles it takes to get there.
+	 */
+	std::vector<Edge> successors(const Listing& listing, std::size_t index) {
+		const Instruction& instruction = listing.instructions()[index];
+		const std::string& m = instruction.mnemonic;
+		const std::uint16_t op = instruction.opcode[0];
+		const std::size_t next = instruction.address + instruction.words;
+
+		if(m == "ret" || m == "reti" || m == "ijmp") {
+			return {{Listing::npos, instruction.cycles}};
+		}
+		if(m == "rjmp") {
+			const int k = (op & 0x0800) ? int(op & 0x0fff) - 0x1000 : int(op & 0x0fff);
+			return {{listing.at(instruction.address + 1 + k), 2}};
+		}
+		if(m == "jmp") {
+			const std::size_t target = (std::size_t(op & 0x01f0) << 13) | (std::size_t(op & 0x0001) << 16) | instruction.opcode[1];
+			return {{listing.at(target), 3}};
+		}
+		if(m == "call" || m == "rcall" || m == "icall") {
+			// The callee is not followed, but takes at least a ret
+			return {{listing.at(next), instruction.cycles + instruction_cycles("ret")}};
+		}
+		if((op & 0xf800) == 0xf000) {
+			// brbs/brbc and all their aliases
+			const int k = (op & 0x0200) ? int((op >> 3) & 0x7f) - 0x80 : int((op >> 3) & 0x7f);
+			return {{listing.at(next), 1}, {listing.at(instruction.address + 1 + k), 2}};
+		}
+		if(m == "cpse" || m == "sbrc" || m == "sbrs" || m == "sbic" || m == "sbis") {
+			const std::size_t skipped = listing.at(next);
+			const std::size_t words = skipped == Listing::npos ? 1 : listing.instructions()[skipped].words;
+			return {{skipped, 1}, {listing.at(next + words), unsigned(1 + words)}};
+		}
+		return {{listing.at(next), instruction.cycles}};
+	}
+
+
+	struct Measurement {
+		double      cycles;
+		std::size_t from;
+		std::size_t to; // Listing::npos: path left the routine
+	};
+
+	/**
+	 * Shortest time from the instruction at `from` to every first `to` event
+	 * reachable from it, in cycles between the two taking effect.
+	 */
+	std::vector<Measurement> measure(const Listing& listing, std::size_t from, const Constraint& constraint) {
+		const auto& instructions = listing.instructions();
+		const Instruction& start = instructions[from];
+		// Writes take effect at the end of the instruction, reads sample half a
+		// cycle before its start
+		const double sample = constraint.to == Event::read ? -0.5 : 0.0;
+
+		std::vector<unsigned> distance(instructions.size(), std::numeric_limits<unsigned>::max());
+		std::priority_queue<std::pair<unsigned, std::size_t>, std::vector<std::pair<unsigned, std::size_t>>, std::greater<>> queue;
+		std::vector<Measurement> result;
+		unsigned exit_distance = std::numeric_limits<unsigned>::max();
+
+		const auto relax = [&](std::size_t index, unsigned cycles) {
+			for(const Edge& edge : successors(listing, index)) {
+				const unsigned d = cycles + edge.cycles;
+				if(edge.to == Listing::npos) {
+					exit_distance = std::min(exit_distance, d);
+				}
+				else if(d < distance[edge.to]) {
+					distance[edge.to] = d;
+					queue.push({d, edge.to});
+				}
+			}
+		};
+
+		relax(from, 0);
+		while(!queue.empty()) {
+			const auto [d, index] = queue.top();
+			queue.pop();
+			if(d != distance[index]) {
+				continue;
+			}
+			const Instruction& instruction = instructions[index];
+			if(instruction.is(constraint.to)) {
+				const double effect = constraint.to == Event::read ? sample : instruction.cycles;
+				result.push_back({d + effect - start.cycles, from, index});
+				continue;
+			}
+			if(constraint.until && instruction.is(*constraint.until)) {
+				continue;
+			}
+			relax(index, d);
+		}
+		if(exit_distance != std::numeric_limits<unsigned>::max()) {
+			// The earliest next event is after returning, and calling again
+			result.push_back({exit_distance + instruction_cycles("call") + sample - start.cycles, from, Listing::npos});
+		}
+		return result;
+	}
+
+
+	void usage(const char* self) {
+		std::cerr << "usage: " << self << " [-f F_CPU] [-g SPEED_GRADE] LISTING\n"
+		          << "speed grades:";
+		for(const auto& grade : speed_grades) {
+			std::cerr << " " << grade.first;
+		}
+		std::cerr << "\n";
+	}
+
+} /* anonymous */
+
+
+int main(const int argc, const char* argv[]) try {
+	double      f_cpu = 16000000;
+	std::string grade = "15";
+	std::string file_name;
+	for(int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if(arg == "-f" && i + 1 < argc) {
+			f_cpu = std::stod(argv[++i]);
+		}
+		else if(arg == "-g" && i + 1 < argc) {
+			grade = argv[++i];
+		}
+		else if(file_name.empty() && arg[0] != '-') {
+			file_name = arg;
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	const auto limits = speed_grades.find(grade);
+	if(file_name.empty() || limits == speed_grades.end()) {
+		usage(argv[0]);
+		return 1;
+	}
+	const double ns_per_cycle = 1e9 / f_cpu;
+
+	const Listing listing{file_name};
+	const auto& instructions = listing.instructions();
+
+	std::cout << "DRAM timing of '" << file_name << "' at " << f_cpu / 1e6 << "MHz, speed grade -" << grade << "\n";
+	std::size_t violations = 0;
+	for(std::size_t c = 0; c < constraint_count; ++c) {
+		const Constraint& constraint = constraints[c];
+		const double required = limits->second[c];
+		std::size_t checked = 0;
+		std::optional<Measurement> worst;
+		for(std::size_t i = 0; i < instructions.size(); ++i) {
+			if(!instructions[i].is(constraint.from)) {
+				continue;
+			}
+			for(const Measurement& measurement : measure(listing, i, constraint)) {
+				++checked;
+				const double ns = measurement.cycles * ns_per_cycle;
+				if(ns < required) {
+					++violations;
+					std::cout << "error: " << constraint.name << " (" << constraint.description << ") is "
+					          << std::fixed << std::setprecision(1) << ns << "ns < " << required << "ns, from "
+					          << listing.location(instructions[measurement.from]) << " to "
+					          << (measurement.to == Listing::npos ? "routine exit" : listing.location(instructions[measurement.to]))
+					          << "\n";
+				}
+				if(!worst || measurement.cycles < worst->cycles) {
+					worst = measurement;
+				}
+			}
+		}
+		std::cout << std::left << std::setw(5) << constraint.name << std::right
+		          << " >= " << std::fixed << std::setprecision(1) << std::setw(6) << required << "ns";
+		if(worst) {
+			std::cout << "  min " << std::setw(6) << worst->cycles * ns_per_cycle << "ns"
+			          << " (" << std::setprecision(1) << worst->cycles << " cycles, " << checked << " paths)"
+			          << "  at " << listing.location(instructions[worst->from]);
+		}
+		else {
+			std::cout << "  (not used)";
+		}
+		std::cout << "\n";
+	}
+
+	if(violations) {
+		std::cerr << "Fatal error: " << violations << " DRAM timing violation(s)" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+catch(const std::exception& e) {
+	std::cerr << "Fatal error: " << e.what() << std::endl;
+	return 1;
+}
@@ -9,11 +9,11 @@
 namespace /* anonymous */ {
 
 	void user_error_fn(png_structp /* png_ptr */, png_const_charp error_msg) {
-		std::cout << "PNG error: " << error_msg << "\n";
+		std::cerr << "PNG error: " << error_msg << "\n";
 	}
 
 	void user_warning_fn(png_structp /* png_ptr */, png_const_charp warning_msg) {
-		std::cout << "PNG warning: " << warning_msg << "\n";
+		std::cerr << "PNG warning: " << warning_msg << "\n";
 	}
 
 } /* anonymous */
@@ -177,6 +177,14 @@ std::uint8_t Glyph::column(std::size_t n) const {
 	return result;
 }
 
+std::vector<std::uint8_t> Glyph::columns() const {
+	std::vector<std::uint8_t> result;
+	for(std::size_t col = m_box.left(); col < m_box.right() + 1; ++col) {
+		result.push_back(column(col));
+	}
+	return result;
+}
+
 
 void Font::load(FILE* source) {
 	std::vector<std::uint8_t> header(8);
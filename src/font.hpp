@@ -47,6 +47,7 @@ class Glyph {
 
 		std::uint8_t row(std::size_t n) const;
 		std::uint8_t column(std::size_t n) const;
+		std::vector<std::uint8_t> columns() const; // all columns within box()
 
 	private:
 		std::uint8_t              m_char;
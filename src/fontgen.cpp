@@ -1,9 +1,11 @@
 #include <algorithm>
+#include <array>
 #include <numeric>
 #include <cmath>
+#include <future>
 #include <iostream>
 #include <map>
-#include <set>
+#include <unordered_map>
 #include <boost/scope_exit.hpp>
 
 #include "font.hpp"
@@ -39,214 +41,271 @@ std::ostream& operator<<(std::ostream& stream, const DBTable& dbt) {
 }
 
 
-int main(const int argc, const char* argv[]) try {
-	const char* input_fn { nullptr };
-	for(int i = 1; i < argc; ++i) {
-		const std::string& arg { argv[i] };
-		if(arg == "-i") {
-			if(i+1 >= argc) {
-				throw std::runtime_error("missing argument to "+arg);
+namespace /* anonymous */ {
+
+	/**
+	 * A font as given on the command line, i.e. `[name=]file.png`. An empty
+	 * file name means stdin.
+	 */
+	struct FontSource {
+		std::string name;
+		std::string file_name;
+	};
+
+	/**
+	 * A loaded font, indexed by character.
+	 */
+	struct IndexedFont {
+		std::string                 name;
+		Font                        font;
+		std::array<const Glyph*, 256> by_char{};
+		std::uint8_t                first_glyph{};
+		std::uint8_t                last_glyph{};
+	};
+
+	/**
+	 * Location of a glyph in the (shared) glyph tables. The table number is
+	 * the same as the width of the glyph.
+	 */
+	struct GlyphRef {
+		std::size_t table;
+		std::size_t index;
+	};
+
+	/**
+	 * The glyph data of all fonts, grouped into one table per glyph width.
+	 * Glyphs with identical pixel data are stored only once, regardless of
+	 * how many fonts or characters use them.
+	 */
+	class GlyphPool {
+		public:
+			GlyphPool(std::size_t space_width)
+			: m_tables(space_width + 1)
+			, m_space {space_width, 0}
+			{
+				// Special case: the first entry of the table of the smallest glyphs
+				// will always map to space, with space being as large as the
+				// smallest character.
+				m_tables[space_width].glyphs = 1;
+				m_tables[space_width].glyph_data.data.assign(space_width, "0x00");
+			}
+
+			GlyphRef insert(const Glyph& glyph) {
+				if(glyph.empty()) {
+					return m_space;
+				}
+				const std::vector<std::uint8_t> columns = glyph.columns();
+				const std::string key(columns.begin(), columns.end());
+				const auto known = m_index.find(key);
+				if(known != m_index.end()) {
+					return known->second;
+				}
+
+				if(m_tables.size() < columns.size() + 1) {
+					m_tables.resize(columns.size() + 1);
+				}
+				Table& table = m_tables[columns.size()];
+				const GlyphRef ref{columns.size(), table.glyphs++};
+				for(const std::uint8_t c : columns) {
+					table.glyph_data.data.push_back(to_hex(c));
+				}
+				m_index.emplace(key, ref);
+				return ref;
+			}
+
+			GlyphRef space() const {
+				return m_space;
+			}
+
+			std::size_t table_count() const {
+				return m_tables.size();
+			}
+
+			std::size_t largest_table() const {
+				return std::max_element(m_tables.begin(), m_tables.end(), [](const auto& lhs, const auto& rhs) {
+					return lhs.glyphs < rhs.glyphs;
+				})->glyphs;
+			}
+
+			std::size_t unique_glyphs() const {
+				return m_index.size();
 			}
+
+			const DBTable& glyph_data(std::size_t table) const {
+				return m_tables[table].glyph_data;
+			}
+
+		private:
+			struct Table {
+				std::size_t glyphs{};
+				DBTable     glyph_data;
+			};
+			std::vector<Table>                        m_tables;
+			GlyphRef                                  m_space;
+			std::unordered_map<std::string, GlyphRef> m_index;
+	};
+
+
+	FontSource parse_font_source(const std::string& arg) {
+		const std::size_t eq = arg.find('=');
+		FontSource result;
+		if(eq == std::string::npos) {
+			// Name the font after the file, e.g. 'build/digits.png' -> 'digits'
+			const std::size_t begin = arg.find_last_of('/') + 1;
+			result.name      = arg.substr(begin, arg.find_last_of('.') - begin);
+			result.file_name = arg;
 		}
 		else {
-			// non option
-			if(!input_fn) input_fn = argv[i];
+			result.name      = arg.substr(0, eq);
+			result.file_name = arg.substr(eq + 1);
 		}
-	}
-
-	FILE* input { nullptr };
-	if(input_fn == nullptr) {
-		std::cerr << "Reading from stdin\n";
-		input = stdin;
-	}
-	else {
-		std::cerr << "Reading from '" << input_fn << "'\n";
-		input = fopen(input_fn, "rb");
-		if(!input) {
-			throw std::runtime_error("error opening file.");
+		if(result.name.empty() || !std::all_of(result.name.begin(), result.name.end(), [](const char c) {
+			return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+		})) {
+			throw std::runtime_error("invalid font name '" + result.name + "' (use [A-Za-z0-9_])");
 		}
+		return result;
 	}
-	BOOST_SCOPE_EXIT(&input_fn, &input) {
-		if(input_fn != nullptr) {
-			fclose(input);
-		}
-	} BOOST_SCOPE_EXIT_END
-
-	std::cout << "#include \"abi.csm\"\n"
-	          << "#include \"utility_macros.csm\"\n"
-	          << "\n\n"
-	          ;
 
 
-	Font fnt;
-	fnt.load(input);
+	IndexedFont load_font(const FontSource& source) {
+		IndexedFont result;
+		result.name = source.name;
 
-	std::vector<std::pair<std::string, std::size_t>> bytes_used;
-	std::map<std::size_t, std::set<Glyph>> size_map;
-	for(const auto& glyph : fnt.glyphs()) {
-		size_map[glyph.box().width()].insert(glyph);
-	}
-	struct GlyphTable {
-		GlyphTable(
-			const std::string& name,
-			std::size_t glyph_width
-		)
-		: glyph_width{glyph_width}
-		, name       {name       }
-		{}
-		std::size_t glyph_width;
-		std::string name;
-		std::vector<Glyph> glyphs;
-		DBTable glyph_data;
-		bool operator==(const GlyphTable& that) const {
-			return this->glyph_width == that.glyph_width &&
-			       this->name        == that.name &&
-			       this->glyphs      == that.glyphs;
-		}
-	};
-	std::vector<std::unique_ptr<GlyphTable>> glyph_tables;
-	std::map<Glyph, const GlyphTable*> glyph_table_map;
-	for(const auto& i : size_map) {
-		if(std::all_of(i.second.begin(), i.second.end(), [](const auto& s) { return s.empty(); })) {
-			continue;
+		FILE* input { stdin };
+		if(!source.file_name.empty()) {
+			input = fopen(source.file_name.c_str(), "rb");
+			if(!input) {
+				throw std::runtime_error("error opening file '" + source.file_name + "'.");
+			}
 		}
-		std::size_t width = i.second.begin()->box().width();
-		std::stringstream comment;
-		comment << "Glyphs " << width << "px wide"
-		        << " (" << i.second.size() << "x)";
-		std::stringstream label;
-		label << "__ssd1306_font_glyphs_" << width << "px";
-
-		glyph_tables.emplace_back(std::make_unique<GlyphTable>(label.str(), width));
-		DBTable& dbt = glyph_tables.back()->glyph_data;
-		if(glyph_tables.size() == 1) {
-			// Special case: the first entry of table 0 will always map to space,
-			// with space being as large as the smallest character.
-			for(std::size_t i = 0; i < width; ++i) {
-				dbt.data.push_back("0x00"); // no pixel data
+		BOOST_SCOPE_EXIT(&input) {
+			if(input != stdin) {
+				fclose(input);
 			}
-			auto space = std::find_if(fnt.glyphs().begin(), fnt.glyphs().end(), [](const auto& g) {
-				return g.character() == ' ';
-			});
-			if(space == fnt.glyphs().end()) {
-				throw std::runtime_error("Space character has no glyph?!");
+		} BOOST_SCOPE_EXIT_END
+		result.font.load(input);
+
+		bool has_glyphs = false;
+		for(const auto& glyph : result.font.glyphs()) {
+			result.by_char[glyph.character()] = &glyph;
+			if(glyph.empty() && glyph.character() != ' ') {
+				continue;
 			}
-			glyph_table_map[*space] = glyph_tables.back().get();
-			glyph_tables.back()->glyphs.push_back(*space);
-		}
-		std::vector<std::uint8_t> table;
-		for(auto s = i.second.begin(); s != i.second.end(); ++s) {
-			if(s->empty()) continue;
-			for(std::size_t col = s->box().left(); col < s->box().right() + 1; ++col) {
-				const std::uint8_t c = s->column(col);
-				assert(!(col == s->box().left() || col == s->box().right()) || c != 0);
-				dbt.data.push_back(to_hex(c));
-				//std::cout << '\t' << s.printable_character() << ": " << s.box() << "\n";
-				//break;
+			if(!has_glyphs || glyph.character() < result.first_glyph) {
+				result.first_glyph = glyph.character();
+			}
+			if(!has_glyphs || glyph.character() > result.last_glyph) {
+				result.last_glyph = glyph.character();
 			}
-			glyph_table_map[*s] = glyph_tables.back().get();
-			glyph_tables.back()->glyphs.push_back(*s);
+			has_glyphs = true;
 		}
+		if(!result.by_char[' ']) {
+			throw std::runtime_error("Space character has no glyph in font '" + result.name + "'?!");
+		}
+
+		return result;
 	}
 
-	// This will hold all the tables, in the end
-	// We have three tables:
-	// 1) A list of pointers into flash, to the first data byte of the first
-	//    glyph in a list of the all the data bytes of all glyphs of the same
-	//    width.
-	// 2) A list of table/index pairs, indicating for each ascii value the table
-	//    and index into that table for the glyph corresponding to that ascii
-	//    value.
-	// 3) Several tables of glyph data, one for each glyph width.
-	DBTable font_data;
 
-	/***************************************************************************
-	 ** Make sure that we can later map glyph-widths to the a table           **
-	 ***************************************************************************/
-	// We need a table to map table entries to table pointers. By making sure
-	// that the index into a table is the same as the width of the character,
-	// we save having to have another table for storing widths, and make the
-	// avr code a (little) bit easier. To do this we ensure that all widths
-	// 0..max_width have a table.
-	const std::size_t widest_glyph = (*std::max_element(
-		glyph_tables.begin(),
-		glyph_tables.end(),
-		[](const auto& lhs, const auto& rhs) {
-			return lhs->glyph_width < rhs->glyph_width;
+	/**
+	 * Decodes all fonts, each on its own thread.
+	 */
+	std::vector<IndexedFont> load_fonts(const std::vector<FontSource>& sources) {
+		std::vector<std::future<IndexedFont>> pending;
+		for(const auto& source : sources) {
+			std::cerr << "Reading font '" << source.name << "' from "
+			          << (source.file_name.empty() ? "stdin" : "'" + source.file_name + "'") << "\n";
+			pending.emplace_back(std::async(std::launch::async, load_font, source));
 		}
-	))->glyph_width;
-	for(std::size_t i = 0; i < widest_glyph + 1; ++i) {
-		const auto table = std::find_if(
-			glyph_tables.begin(),
-			glyph_tables.end(),
-			[=](const auto& e) {
-				return e->glyph_width == i;
-			}
-		);
-		if(table == glyph_tables.end()) {
-			glyph_tables.emplace_back(std::make_unique<GlyphTable>("__ssd1306_font_glyphs_" + std::to_string(i) + "px", 0));
+
+		std::vector<IndexedFont> result;
+		for(auto& font : pending) {
+			result.emplace_back(font.get());
 		}
+		return result;
 	}
 
-	// Make sure tables are sorted according to glyph width
-	std::sort(glyph_tables.begin(), glyph_tables.end(), [](const auto& lhs, const auto& rhs){
-		return lhs->glyph_width < rhs->glyph_width;
-	});
+} /* anonymous */
+
+
+int main(const int argc, const char* argv[]) try {
+	std::vector<FontSource> sources;
+	for(int i = 1; i < argc; ++i) {
+		sources.emplace_back(parse_font_source(argv[i]));
+		if(std::any_of(sources.begin(), sources.end() - 1, [&](const auto& s) { return s.name == sources.back().name; })) {
+			throw std::runtime_error("font '" + sources.back().name + "' specified more than once");
+		}
+	}
+	if(sources.empty()) {
+		sources.push_back({"default", ""});
+	}
+
+	const std::vector<IndexedFont> fonts = load_fonts(sources);
+
+	std::cout << "#include \"abi.csm\"\n"
+	          << "#include \"utility_macros.csm\"\n"
+	          << "\n\n"
+	          ;
 
+	std::vector<std::pair<std::string, std::size_t>> bytes_used;
 
 	/***************************************************************************
-	 ** ??                                                            **
+	 ** Gather the glyph data of all fonts into the shared tables             **
 	 ***************************************************************************/
-	// fill out the glyph table with missing characters, mapping them to space
-	// (or to '.' or '?')
-	std::uint8_t first_glyph = std::min_element(
-		glyph_table_map.begin(),
-		glyph_table_map.end(),
-		[](const auto& lhs, const auto& rhs) {
-			return lhs.first.character() < rhs.first.character();
-		}
-	)->first.character();
-	std::uint8_t last_glyph = std::max_element(
-		glyph_table_map.begin(),
-		glyph_table_map.end(),
-		[](const auto& lhs, const auto& rhs) {
-			return lhs.first.character() < rhs.first.character();
+	std::size_t smallest_glyph = 8;
+	for(const auto& fnt : fonts) {
+		for(const auto& glyph : fnt.font.glyphs()) {
+			if(!glyph.empty()) {
+				smallest_glyph = std::min(smallest_glyph, glyph.box().width());
+			}
 		}
-	)->first.character();
-	auto space = std::find_if(fnt.glyphs().begin(), fnt.glyphs().end(), [](const auto& g) {
-		return g.character() == ' ';
-	});
-	if(space == fnt.glyphs().end()) {
-		throw std::runtime_error("Space character has no glyph?!");
 	}
-	auto space_table = std::find_if(glyph_tables.begin(), glyph_tables.end(), [&](const auto& table) {
-		return std::find(table->glyphs.begin(), table->glyphs.end(), *space) != table->glyphs.end();
-	});
-	assert(space_table != glyph_tables.end());
-	for(char i = first_glyph; i < last_glyph; ++i) {
-		if(std::find_if(glyph_table_map.begin(), glyph_table_map.end(), [=](const auto& g) {
-			return g.first.character() == i;
-		}) == glyph_table_map.end()) {
-			glyph_table_map[*space] = space_table->get();
+	GlyphPool pool{smallest_glyph};
+
+	// For each font, the glyph of every character in first_glyph..last_glyph.
+	// Characters without a glyph are mapped to space.
+	std::vector<std::vector<GlyphRef>> glyph_maps;
+	for(const auto& fnt : fonts) {
+		glyph_maps.emplace_back();
+		for(std::size_t ascii = fnt.first_glyph; ascii < fnt.last_glyph + 1u; ++ascii) {
+			const Glyph* glyph = fnt.by_char[ascii];
+			glyph_maps.back().push_back(glyph ? pool.insert(*glyph) : pool.space());
 		}
 	}
 
+	// This will hold all the tables, in the end
+	// We have three tables:
+	// 1) A list of pointers into flash, to the first data byte of the first
+	//    glyph in a list of the all the data bytes of all glyphs of the same
+	//    width.
+	// 2) For each font, a list of table/index pairs, indicating for each ascii
+	//    value the table and index into that table for the glyph corresponding
+	//    to that ascii value.
+	// 3) Several tables of glyph data, one for each glyph width, shared by all
+	//    fonts.
+	DBTable font_data;
+
 	/***************************************************************************
 	 ** Determine number of bits needed to represent tables and indices       **
 	 ***************************************************************************/
-	const std::size_t n_table_bits = std::ceil(std::log2(glyph_tables.size()));
-	const std::size_t n_index_bits = std::ceil(std::log2(
-		(*std::max_element(glyph_tables.begin(), glyph_tables.end(), [](const auto& lhs, const auto& rhs) {
-			return lhs->glyphs.size() < rhs->glyphs.size();
-		}))->glyphs.size()
-	));
+	// By making sure that the index into a table is the same as the width of
+	// the character, we save having to have another table for storing widths,
+	// and make the avr code a (little) bit easier. The pool has a table for
+	// all widths 0..max_width (empty ones included) to ensure this.
+	const std::size_t n_table_bits = std::ceil(std::log2(pool.table_count()));
+	const std::size_t n_index_bits = std::ceil(std::log2(pool.largest_table()));
 	if(n_table_bits > 8 || n_index_bits > 8) {
 		throw std::runtime_error("this many bits should not be needed for indexing!");
 	}
+	const std::size_t n_entry_bits = n_table_bits + n_index_bits;
+	// An entry starts a multiple of gcd(n_entry_bits, 8) bits into its first
+	// byte, so with that offset it spans up to 3 bytes.
+	const std::size_t max_bit_offset = 8 - std::gcd<std::size_t>(n_entry_bits, 8);
+	const std::size_t n_entry_bytes = (max_bit_offset + n_entry_bits + 7) / 8;
+	assert(n_entry_bytes >= 1 && n_entry_bytes <= 3);
 
 	std::cout << "\n\n"
-	          << "#define __ssd1306_font_first_glyph (" << to_hex(first_glyph)                       << ")\n"
-	          << "#define __ssd1306_font_last_glyph ("  << to_hex(last_glyph)                        << ")\n"
 	          << "#define __ssd1306_font_table_bits ("  << to_hex<std::uint8_t>(n_table_bits)        << ")\n"
 	          << "#define __ssd1306_font_table_mask ("  << to_hex<std::uint8_t>((1<<n_table_bits)-1) << ")\n"
 	          << "#define __ssd1306_font_index_bits ("  << to_hex<std::uint8_t>(n_index_bits)        << ")\n"
@@ -256,25 +315,32 @@ int main(const int argc, const char* argv[]) try {
 	          // first two (fake) table entries
 	          << "#define __ssd1306_font_missing_glyph_offset 0\n"
 	          << "#define __ssd1306_font_missing_glyph_width 2\n"
+	          << "\n"
+	          << "#define __ssd1306_font_default " << fonts.front().name << "\n"
 	          ;
 
 	/***************************************************************************
 	 ** Map glyph-widths to the corresponding table                           **
 	 ***************************************************************************/
-	DBTable glyph_width_table;
-	assert(font_data.data.size() == 0);
 	// table_start_offset is the offset into the final table where the first byte
 	// of the first glyph of a table starts.
-	// Glyph data starts after the list of table pointers (table 1), and the map
-	// of ascii to table-index (table 2).
-	std::size_t table_start_offset = glyph_tables.size()*2 +
-	                                 ((last_glyph-first_glyph+1)*(n_table_bits+n_index_bits)+7)/8;
-	for(const auto& table : glyph_tables) {
-		if(table->glyph_width != 0) {
+	// Glyph data starts after the list of table pointers (table 1), and the maps
+	// of ascii to table-index of all fonts (table 2).
+	std::vector<std::size_t> glyph_map_offsets;
+	std::size_t table_start_offset = pool.table_count()*2;
+	for(const auto& glyph_map : glyph_maps) {
+		glyph_map_offsets.push_back(table_start_offset);
+		table_start_offset += (glyph_map.size()*n_entry_bits+7)/8;
+	}
+
+	DBTable glyph_width_table;
+	for(std::size_t width = 0; width < pool.table_count(); ++width) {
+		const DBTable& glyph_data = pool.glyph_data(width);
+		if(!glyph_data.data.empty()) {
 			glyph_width_table.data.push_back("low(FLASH_ADDR(__ssd1306_font_data) + " + to_hex<std::uint16_t>(table_start_offset) + ")");
 			glyph_width_table.data.push_back("high(FLASH_ADDR(__ssd1306_font_data) + " + to_hex<std::uint16_t>(table_start_offset) + ")");
-			std::cout << "; offset glyph width table " << table->glyph_width << "px: " << to_hex(table_start_offset) << "\n";
-			table_start_offset += table->glyph_data.data.size();
+			std::cout << "; offset glyph width table " << width << "px: " << to_hex(table_start_offset) << "\n";
+			table_start_offset += glyph_data.data.size();
 		}
 		else {
 			// the 'empty glyph' also doesn't have any entry in the glyph data later on
@@ -288,68 +354,77 @@ int main(const int argc, const char* argv[]) try {
 	/***************************************************************************
 	 ** Map ascii characters to glyph (table and index-in-table)              **
 	 ***************************************************************************/
-	std::map<char, Glyph> ascii_order_glyph_map;
-	for(std::uint8_t ascii = first_glyph; ascii < last_glyph+1; ++ascii) {
-		auto glyph = std::find_if(fnt.glyphs().begin(), fnt.glyphs().end(), [=](const auto& glyph) {
-			return glyph.character() == ascii;
-		});
-		assert(glyph != fnt.glyphs().end());
-		assert(glyph_table_map.count(*glyph));
-		ascii_order_glyph_map[ascii] = *glyph;
-	}
-
-	std::uint32_t packed{};
-	std::size_t bits_in_pack{};
-	DBTable index_table;
-	for(const auto e : ascii_order_glyph_map) {
-		const GlyphTable* table = glyph_table_map[e.second];
-		const std::size_t nth_table = std::distance(
-			glyph_tables.begin(),
-			std::find_if(glyph_tables.begin(), glyph_tables.end(), [=](const auto& t) {
-				return table == t.get();
-			})
-		);
-		const std::size_t index = std::distance(
-			table->glyphs.begin(),
-			std::find(
-				table->glyphs.begin(),
-				table->glyphs.end(),
-				e.second)
-			);
-		assert(index < 256);
-		assert(nth_table < 256);
-		packed = (packed << (n_index_bits+n_table_bits)) | (index << n_table_bits) | (nth_table << 0);
-		bits_in_pack += n_index_bits+n_table_bits;
-		while(bits_in_pack >= 8) {
-			index_table.data.push_back(to_hex<std::uint8_t>(packed>>(bits_in_pack-8)));
-			bits_in_pack -= 8;
+	for(std::size_t f = 0; f < fonts.size(); ++f) {
+		std::uint32_t packed{};
+		std::size_t bits_in_pack{};
+		DBTable index_table;
+		std::vector<std::uint8_t> index_bytes;
+		for(const GlyphRef& ref : glyph_maps[f]) {
+			assert(ref.index < 256);
+			assert(ref.table < 256);
+			packed = (packed << n_entry_bits) | (ref.index << n_table_bits) | (ref.table << 0);
+			bits_in_pack += n_entry_bits;
+			while(bits_in_pack >= 8) {
+				index_bytes.push_back(packed>>(bits_in_pack-8));
+				index_table.data.push_back(to_hex<std::uint8_t>(index_bytes.back()));
+				bits_in_pack -= 8;
+			}
 		}
-	}
-	assert(bits_in_pack < 8);
-	while(bits_in_pack) {
-		if(bits_in_pack < 8) {
-			packed <<=1;
-			++bits_in_pack;
+		assert(bits_in_pack < 8);
+		while(bits_in_pack) {
+			if(bits_in_pack < 8) {
+				packed <<=1;
+				++bits_in_pack;
+			}
+			else {
+				index_bytes.push_back(packed>>(bits_in_pack-8));
+				index_table.data.push_back(to_hex<std::uint8_t>(index_bytes.back()));
+				bits_in_pack -= 8;
+			}
 		}
-		else {
-			index_table.data.push_back(to_hex<std::uint8_t>(packed>>(bits_in_pack-8)));
-			bits_in_pack -= 8;
+		assert(bits_in_pack == 0);
+		if(index_table.data.size() > 256) {
+			throw std::runtime_error("character map of font '" + fonts[f].name + "' does not fit in 256 bytes");
 		}
+		// Check that every entry decodes like __ssd1306_font_get_data_ptr does
+		// it: n_entry_bytes bytes from the byte the entry starts in (reading
+		// on into whatever follows the map), shifted right to align the table
+		// bits and then the index bits.
+		for(std::size_t i = 0; i < glyph_maps[f].size(); ++i) {
+			const std::size_t bit = i * n_entry_bits;
+			std::uint32_t entry{};
+			for(std::size_t byte = 0; byte < n_entry_bytes; ++byte) {
+				const std::size_t offset = bit / 8 + byte;
+				entry = (entry << 8) | (offset < index_bytes.size() ? index_bytes[offset] : 0);
+			}
+			assert(bit % 8 <= max_bit_offset);
+			entry >>= 8*n_entry_bytes - n_entry_bits - bit % 8;
+			const std::size_t table = entry & ((1<<n_table_bits)-1);
+			const std::size_t index = (entry >> n_table_bits) & ((1<<n_index_bits)-1);
+			if(table != glyph_maps[f][i].table || index != glyph_maps[f][i].index) {
+				throw std::runtime_error("character map of font '" + fonts[f].name + "' does not decode at " + std::to_string(i));
+			}
+		}
+		assert(font_data.data.size() == glyph_map_offsets[f]);
+		font_data.data.insert(font_data.data.end(), index_table.data.begin(), index_table.data.end());
+		bytes_used.emplace_back("Character to glyph table/index mapping (" + fonts[f].name + ")", index_table.data.size());
+
+		const std::string prefix = "#define __ssd1306_font_" + fonts[f].name;
+		std::cout << prefix << "_first_glyph (" << to_hex(fonts[f].first_glyph)          << ")\n"
+		          << prefix << "_last_glyph ("  << to_hex(fonts[f].last_glyph)           << ")\n"
+		          << prefix << "_ascii_order_glyph_map_offset (" << to_hex(glyph_map_offsets[f]) << ")\n"
+		          ;
 	}
-	assert(bits_in_pack == 0);
-	font_data.data.insert(font_data.data.end(), index_table.data.begin(), index_table.data.end());
-	bytes_used.emplace_back("Character to glyph table/index mapping", index_table.data.size());
-	std::size_t ascii_order_glyph_map_offset = glyph_tables.size()*2;
-	std::cout << "#define __ssd1306_font_ascii_order_glyph_map_offset (" << to_hex(ascii_order_glyph_map_offset) << ")\n";
 
 
 	/***************************************************************************
 	 ** Glyph data                                                            **
 	 ***************************************************************************/
 	bytes_used.emplace_back("Glyph data", 0);
-	for(const auto& table : glyph_tables) {
-		font_data.data.insert(font_data.data.end(), table->glyph_data.data.begin(), table->glyph_data.data.end());
-		bytes_used.back().second += table->glyph_data.data.size();
+	for(std::size_t width = 0; width < pool.table_count(); ++width) {
+		const DBTable& glyph_data = pool.glyph_data(width);
+		font_data.data.insert(font_data.data.end(), glyph_data.data.begin(), glyph_data.data.end());
+		bytes_used.back().second += glyph_data.data.size();
 	}
 	bytes_used.back().second += font_data.data.size() % 2;
 
@@ -364,22 +439,45 @@ int main(const int argc, const char* argv[]) try {
 	 ** Code                                                                  **
 	 ***************************************************************************/
 	std::cout << "\n\n"
+	          << ".dseg"                                                          "\n"
+	          << "__ssd1306_font_selected: .byte 2 ; entry point of the font in use" "\n"
+	          << ".cseg"                                                          "\n"
+	          << "\n"
 	          << "; returns (in z) the address (in flash) of the first data byte" "\n"
 	          << "; of the requested character (r16), and the size (width) of"    "\n"
 	          << "; the character in r25."                                        "\n"
 	          << "__ssd1306_font_get_data_ptr:"                                   "\n"
-	          << "\tldi    zl, low(FLASH_ADDR(__ssd1306_font_data)+__ssd1306_font_ascii_order_glyph_map_offset)"  "\n"
-	          << "\tldi    zh, high(FLASH_ADDR(__ssd1306_font_data)+__ssd1306_font_ascii_order_glyph_map_offset)" "\n"
-	          << "\t"                                                             "\n"
-	          << "\t; first of all, see if the requested character has a glyph"   "\n"
-	          << "\tmov    r24, r16"                                              "\n"
-	          << "\tsubi   r24, __ssd1306_font_first_glyph"                       "\n"
-	          << "\tcpi    r24, __ssd1306_font_last_glyph - __ssd1306_font_first_glyph + 1" "\n"
+	          << "\tlds    zl, __ssd1306_font_selected+1"                         "\n"
+	          << "\tlds    zh, __ssd1306_font_selected+0"                         "\n"
+	          << "\tijmp"                                                         "\n"
+	          ;
+	for(const auto& fnt : fonts) {
+		const std::string prefix = "__ssd1306_font_" + fnt.name;
+		std::cout << "\n"
+		          << prefix << "_get_data_ptr:"                                     "\n"
+		          << "\tldi    zl, low(FLASH_ADDR(__ssd1306_font_data)+" << prefix << "_ascii_order_glyph_map_offset)"  "\n"
+		          << "\tldi    zh, high(FLASH_ADDR(__ssd1306_font_data)+" << prefix << "_ascii_order_glyph_map_offset)" "\n"
+		          << "\t"                                                           "\n"
+		          << "\t; first of all, see if the requested character has a glyph" "\n"
+		          << "\tmov    r24, r16"                                            "\n"
+		          << "\tsubi   r24, " << prefix << "_first_glyph"                   "\n"
+		          << "\tldi    r25, " << prefix << "_last_glyph - " << prefix << "_first_glyph + 1" "\n"
+		          << "\trjmp   __ssd1306_font_get_data_ptr_check"                   "\n"
+		          ;
+	}
+	// A single check that all fonts jump to, rather than a branch in every font
+	// entry, which would be out of range of the last ones with many fonts.
+	std::cout << "\n"
+	          << "__ssd1306_font_get_data_ptr_check:"                             "\n"
+	          << "\tcp     r24, r25    ; r25 is the number of glyphs in the font" "\n"
 	          << "\tbrlo   __ssd1306_font_get_data_ptr_exists"                    "\n"
+	          << "\n"
+	          << "__ssd1306_font_get_data_ptr_missing:"                           "\n"
 	          << "\tldi    zl, low(FLASH_ADDR(__ssd1306_font_data)+__ssd1306_font_missing_glyph_offset)"  "\n"
 	          << "\tldi    zh, high(FLASH_ADDR(__ssd1306_font_data)+__ssd1306_font_missing_glyph_offset)" "\n"
 	          << "\tldi    r25, __ssd1306_font_missing_glyph_width"               "\n"
 	          << "\tret"                                                          "\n"
+	          << "\n"
 	          << "__ssd1306_font_get_data_ptr_exists:"                            "\n"
 	          << "\tsave_registers(r20, r21, r22, r23, xl, xh)"                   "\n"
 	          <<                                                                  "\n"
@@ -414,52 +512,41 @@ int main(const int argc, const char* argv[]) try {
 	          << "\t; step 2: determine the table and index into the table"       "\n"
 	          << "\t;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;" "\n"
 	          ;
-	// In the table, bits are stored high--low, index first, then table id
-	if(n_index_bits + n_table_bits > 9) std::cout
-	          << "\tlpm    r22, z+"                                               "\n";
-	if(n_index_bits + n_table_bits != 8) std::cout
-	          << "\tlpm    r21, z+"                                               "\n";
-	std::cout << "\tlpm    r20, z+"                                               "\n";
-	if(n_index_bits + n_table_bits != 8) std::cout
-	          <<                                                                  "\n"
-	          << "\tmov    r24, xh    ; bit offset"                               "\n"
-	          << "\tsubi   r24, -(__ssd1306_font_table_bits+__ssd1306_font_index_bits)"                                                             "\n"
-	          << "\tldi    r23, 16"                                               "\n"
-	          << "\tsub    r23, r24"                                              "\n"
+	// In the table, bits are stored high--low, index first, then table id. The
+	// bytes of an entry are loaded high to low into r22:r21:r20, and shifted
+	// right in place (checked with the character maps above).
+	const std::array<const char*, 3> entry_regs{"r20", "r21", "r22"};
+	std::string shift_entry = "\tlsr    " + std::string(entry_regs[n_entry_bytes-1]) + "\n";
+	for(std::size_t byte = n_entry_bytes-1; byte--; ) {
+		shift_entry += "\tror    " + std::string(entry_regs[byte]) + "\n";
+	}
+	for(std::size_t byte = n_entry_bytes; byte--; ) {
+		std::cout << "\tlpm    " << entry_regs[byte] << ", z+"                 "\n";
+	}
+	std::cout <<                                                                "\n"
+	          << "\tldi    r23, " << 8*n_entry_bytes << "-(__ssd1306_font_table_bits+__ssd1306_font_index_bits)" "\n"
+	          << "\tsub    r23, xh"                                               "\n"
 	          << "\t; r23 = amount to shift right to align table bits"            "\n"
-	          << "\tandi   r23, 16-1"                                             "\n"
-	          <<                                                                  "\n"
-	          << "\tmov    r24, r20"                                              "\n"
-	          << "\tmov    r25, r21"                                              "\n"
 	          << "__ssd1306_font_extract_table_bits:"                             "\n"
 	          << "\tcp     r23, rC0"                                              "\n"
 	          << "\tbreq   __ssd1306_font_extract_table_bits_done"                "\n"
-	          << "\tlsr    r25"                                                   "\n"
-	          << "\tror    r24"                                                   "\n"
+	          << shift_entry
 	          << "\tdec    r23"                                                   "\n"
 	          << "\trjmp   __ssd1306_font_extract_table_bits"                     "\n"
 	          << "__ssd1306_font_extract_table_bits_done:"                        "\n"
-	          << "\tmov    xl, r24     ; xl is the table index"                   "\n"
+	          << "\tmov    xl, r20     ; xl is the table index"                   "\n"
 	          << "\tandi   xl, __ssd1306_font_table_mask"                         "\n"
 	          <<                                                                  "\n"
-	          << "\tmov    r24, xh     ; bit offset"                              "\n"
-	          << "\tsubi   r24, -(__ssd1306_font_index_bits)"                     "\n"
-	          << "\tldi    r23, 16"                                               "\n"
-	          << "\tsub    r23, r24"                                              "\n"
+	          << "\tldi    r23, __ssd1306_font_table_bits"                        "\n"
 	          << "\t; r23 = amount to shift right to align index bits"            "\n"
-	          << "\tandi   r23, 16-1"                                             "\n"
-	          <<                                                                  "\n"
-	          << "\tmov    r24, r20-"                                              "\n"
-	          << "\tmov    r25, r21"                                              "\n"
 	          << "__ssd1306_font_extract_index_bits:"                             "\n"
 	          << "\tcp     r23, rC0"                                              "\n"
 	          << "\tbreq   __ssd1306_font_extract_index_bits_done"                "\n"
-	          << "\tlsr    r25"                                                   "\n"
-	          << "\tror    r24"                                                   "\n"
+	          << shift_entry
 	          << "\tdec    r23"                                                   "\n"
 	          << "\trjmp   __ssd1306_font_extract_index_bits"                     "\n"
 	          << "__ssd1306_font_extract_index_bits_done:"                        "\n"
-	          << "\tmov    xh, r24     ; xh is the index in the table"            "\n"
+	          << "\tmov    xh, r20     ; xh is the index in the table"            "\n"
 	          << "\tandi   xh, __ssd1306_font_index_mask"                         "\n"
 	          <<                                                                  "\n"
 	          << "\t;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;" "\n"
@@ -489,8 +576,9 @@ int main(const int argc, const char* argv[]) try {
 	          ;
 
 
-	const std::size_t n_glyphs = std::accumulate(fnt.glyphs().begin(), fnt.glyphs().end(), 0, [](const std::size_t a, const auto& g) { return a + !g.empty(); });
+	const std::size_t n_glyphs = pool.unique_glyphs();
 	std::cout << "\n\n"
+	          << "; Number of fonts: "    << fonts.size() << '\n'
 	          << "; Number of glyphs: "   << n_glyphs << '\n';
 	bytes_used.emplace_back("Total storage used", font_data.storage_size());
 	for(const auto& e : bytes_used) {
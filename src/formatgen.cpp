@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util.hpp"
+
+/**
+ * Generator for the pieces of the PRINTF_FORMAT() format strings.
+ *
+ *   formatgen SOURCE...
+ *
+ * Scans the given sources for PRINTF_FORMAT(name, "format"), and writes the
+ * pre-parsed pieces of every format to stdout, for libc.csm to pick up (see
+ * PRINTF_FORMAT there):
+ *
+ *   #define __printf_format_pieces_<name> ((text, length, .db components))
+ *                                         ((arg, conversion specifier)) ...
+ *
+ * The format is a plain C string literal (adjacent literals are joined) with
+ * the escapes \r \n \t \\ \" \' and \xHH, and the conversions %% %c %s and
+ * %[hh|h|l]x / X / d of _printf. Text is split into pieces of at most 64
+ * characters, the most PRINTF_FORMAT() can pad. Comments and preprocessor
+ * directives (which includes the PRINTF_FORMAT() definition) are skipped.
+ */
+
+namespace /* anonymous */ {
+
+	constexpr std::size_t max_text_length = 64;
+
+	struct Piece {
+		std::string text; // literal text, if spec is empty
+		std::string spec; // conversion specifier, e.g. "hhx"
+	};
+
+	struct Format {
+		std::string        name;
+		std::string        location;
+		std::vector<Piece> pieces;
+	};
+
+
+	std::string read_file(const std::string& file_name) {
+		std::ifstream file(file_name);
+		if(!file) {
+			throw std::runtime_error("could not open '" + file_name + "'");
+		}
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	// Replaces comments (//, /* */ and ;) and preprocessor directives by
+	// spaces, keeping the line breaks so that offsets still give line numbers.
+	std::string blank_comments(std::string source) {
+		enum class State { code, string, character, line_comment, asm_comment, block_comment, directive };
+		State state = State::code;
+		bool line_start = true;
+		for(std::size_t i = 0; i < source.size(); ++i) {
+			const char c = source[i];
+			const char next = i + 1 < source.size() ? source[i+1] : '\0';
+			const bool continued = c == '\\' && next == '\n';
+			switch(state) {
+			case State::code:
+				if(c == '#' && line_start) {
+					state = State::directive;
+				}
+				else if(c == '/' && next == '/') {
+					state = State::line_comment;
+				}
+				else if(c == '/' && next == '*') {
+					state = State::block_comment;
+					source[i++] = ' ';
+				}
+				else if(c == ';') {
+					state = State::asm_comment;
+				}
+				else if(c == '"') {
+					state = State::string;
+				}
+				else if(c == '\'') {
+					state = State::character;
+				}
+				break;
+			case State::string:
+			case State::character:
+				if(c == '\\') {
+					++i;
+				}
+				else if(c == (state == State::string ? '"' : '\'') || c == '\n') {
+					state = State::code;
+				}
+				break;
+			case State::line_comment:
+			case State::directive:
+				if(continued) {
+					source[i++] = ' '; // keep the line break
+					line_start = false;
+					continue;
+				}
+				if(c == '\n') {
+					state = State::code;
+				}
+				break;
+			case State::asm_comment:
+				if(c == '\n') {
+					state = State::code;
+				}
+				break;
+			case State::block_comment:
+				if(c == '*' && next == '/') {
+					source[i++] = ' ';
+					source[i] = ' ';
+					state = State::code;
+					continue;
+				}
+				break;
+			}
+			if(c != '\n' && (state == State::line_comment || state == State::asm_comment
+			                 || state == State::block_comment || state == State::directive)) {
+				source[i] = ' ';
+			}
+			line_start = c == '\n' || (line_start && (c == ' ' || c == '\t'));
+		}
+		return source;
+	}
+
+	unsigned hex_digit(const char c) {
+		if(c >= '0' && c <= '9') return c - '0';
+		if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+		throw std::runtime_error(std::string("invalid hex digit '") + c + "'");
+	}
+
+	// Parses the string literal(s) at pos, up to the closing parenthesis.
+	std::string parse_literals(const std::string& source, std::size_t& pos) {
+		std::string result;
+		bool any = false;
+		while(true) {
+			while(pos < source.size() && std::isspace(static_cast<unsigned char>(source[pos]))) {
+				++pos;
+			}
+			if(pos < source.size() && source[pos] == ')' && any) {
+				return result;
+			}
+			if(pos >= source.size() || source[pos] != '"') {
+				throw std::runtime_error("the format must be a string literal");
+			}
+			for(++pos; pos < source.size() && source[pos] != '"'; ++pos) {
+				char c = source[pos];
+				if(c == '\n') {
+					throw std::runtime_error("unterminated string literal");
+				}
+				if(c == '\\' && ++pos < source.size()) {
+					switch(c = source[pos]) {
+					case 'r':  c = '\r'; break;
+					case 'n':  c = '\n'; break;
+					case 't':  c = '\t'; break;
+					case '\\':
+					case '"':
+					case '\'':
+						break;
+					case 'x':
+						if(pos + 2 >= source.size()) {
+							throw std::runtime_error("incomplete \\x escape");
+						}
+						c = static_cast<char>(hex_digit(source[pos+1]) << 4 | hex_digit(source[pos+2]));
+						pos += 2;
+						break;
+					default:
+						throw std::runtime_error(std::string("unsupported escape '\\") + c + "'");
+					}
+				}
+				result += c;
+			}
+			++pos;
+			any = true;
+		}
+	}
+
+	std::vector<Piece> split_format(const std::string& format) {
+		std::vector<Piece> pieces;
+		const auto add_text = [&](const char c) {
+			if(pieces.empty() || !pieces.back().spec.empty() || pieces.back().text.size() == max_text_length) {
+				pieces.emplace_back();
+			}
+			pieces.back().text += c;
+		};
+		for(std::size_t i = 0; i < format.size(); ++i) {
+			if(format[i] != '%') {
+				add_text(format[i]);
+				continue;
+			}
+			std::string spec;
+			for(const char* length : {"hh", "h", "l"}) {
+				if(format.compare(i + 1, std::string(length).size(), length) == 0) {
+					spec = length;
+					break;
+				}
+			}
+			i += spec.size() + 1;
+			const char conversion = i < format.size() ? format[i] : '\0';
+			if(conversion == '%' && spec.empty()) {
+				add_text('%');
+			}
+			else if(conversion == 'x' || conversion == 'X' || conversion == 'd'
+			        || ((conversion == 'c' || conversion == 's') && spec.empty())) {
+				pieces.push_back({"", spec + conversion});
+			}
+			else {
+				throw std::runtime_error("unsupported conversion '%" + spec + (conversion ? std::string(1, conversion) : "") + "'");
+			}
+		}
+		if(pieces.empty()) {
+			throw std::runtime_error("empty format");
+		}
+		return pieces;
+	}
+
+	// .db components for text: printable characters are quoted, others (and
+	// those that would upset avra or the $ line splitting) are numbers.
+	std::string db_components(const std::string& text) {
+		std::string result;
+		bool quoted = false;
+		for(const char c : text) {
+			const bool printable = c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != ';' && c != '$';
+			if(quoted && !printable) {
+				result += '"';
+				quoted = false;
+			}
+			if(!quoted) {
+				result += result.empty() ? "" : ", ";
+			}
+			if(printable) {
+				result += quoted ? "" : "\"";
+				result += c;
+				quoted = true;
+			}
+			else {
+				result += to_hex<std::uint8_t>(c);
+			}
+		}
+		return result + (quoted ? "\"" : "");
+	}
+
+	std::vector<Format> scan(const std::string& file_name) {
+		const std::string source = blank_comments(read_file(file_name));
+		const std::regex  use(R"(\bPRINTF_FORMAT\s*\(\s*([A-Za-z_]\w*)\s*,)");
+		std::vector<Format> formats;
+		for(auto match = std::sregex_iterator(source.begin(), source.end(), use); match != std::sregex_iterator(); ++match) {
+			const std::size_t line = std::count(source.begin(), source.begin() + match->position(), '\n') + 1;
+			const std::string location = file_name + ":" + std::to_string(line);
+			try {
+				std::size_t pos = match->position() + match->length();
+				formats.push_back({(*match)[1], location, split_format(parse_literals(source, pos))});
+			}
+			catch(const std::exception& e) {
+				throw std::runtime_error(location + ": PRINTF_FORMAT(" + (*match)[1].str() + "): " + e.what());
+			}
+		}
+		return formats;
+	}
+
+} /* anonymous */
+
+
+int main(const int argc, const char* argv[]) try {
+	if(argc < 2) {
+		std::cerr << "usage: " << argv[0] << " SOURCE...\n";
+		return 1;
+	}
+
+	std::map<std::string, std::string> locations;
+	std::stringstream out;
+	out << "// Generated by formatgen, the pieces of all PRINTF_FORMAT() format strings\n";
+	for(int i = 1; i < argc; ++i) {
+		for(const Format& format : scan(argv[i])) {
+			if(!locations.emplace(format.name, format.location).second) {
+				throw std::runtime_error(format.location + ": PRINTF_FORMAT(" + format.name + ") already defined at " + locations[format.name]);
+			}
+			out << "\n// " << format.location << "\n"
+			    << "#define __printf_format_pieces_" << format.name;
+			for(const Piece& piece : format.pieces) {
+				out << " \\\n\t";
+				if(piece.spec.empty()) {
+					out << "((text, " << piece.text.size() << ", " << db_components(piece.text) << "))";
+				}
+				else {
+					out << "((arg, " << piece.spec << "))";
+				}
+			}
+			out << "\n";
+		}
+	}
+	std::cout << out.str();
+	return 0;
+}
+catch(const std::exception& e) {
+	std::cerr << "Fatal error: " << e.what() << std::endl;
+	return 1;
+}
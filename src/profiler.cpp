@@ -0,0 +1,862 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_eeprom.h>
+
+#include "util.hpp"
+
+/**
+ * Instruction-level profiler for the firmware, running under simavr.
+ *
+ *   profiler [-f F_CPU] [-c CYCLES] [-s SYMBOL] [-o PROFILE] [-F FOLDED] [-n TOP] FIRMWARE LISTING
+ *   profiler -r PROFILE [-f F_CPU] [-F FOLDED] [-n TOP] LISTING
+ *
+ * Runs the firmware (.bin) until it reaches SYMBOL (default _debug_break, the
+ * end of a test run either way) or for at most CYCLES, and counts the cycles
+ * spent at every program address, per call stack. The call stack is shadowed
+ * from the calls and interrupts the simulation makes, and a frame is dropped
+ * as soon as the stack pointer is above its return address again (ret, reti,
+ * or the stack being reset).
+ *
+ * The test key (PINC5) is pressed once the firmware waits for it (at
+ * wait_for_key_press), not through reset, and the EEPROM holds the topology
+ * slot of TOPOLOGY_CHIP_TYPE with the logical defaults, so topology discovery
+ * is skipped. Reaching discover_symbol anyway means that slot no longer matches
+ * topology.csm, which is an error. A 4164 is simulated on the pins memtest4164 uses, so a full run
+ * passes like it would with a good chip. Delays return as soon as they are
+ * called (at delay_symbol), so their busy waiting, which would be most of a
+ * run (the fade tests alone wait 10 minutes), is neither simulated nor counted.
+ *
+ * The counts are written to PROFILE (-o), from which the report can be made
+ * again without running the simulation (-r). Addresses are mapped to the
+ * labels and lines of the avra LISTING; the DEF_LABELED markers in it add the
+ * source file and line of the definition. A routine is a DEF_LABELED label, a
+ * call or jmp target, or an address that was entered by a call at run time;
+ * other labels only name places within a routine. The report has
+ *  - inclusive and exclusive cycles per routine, and the number of calls,
+ *  - the callers each routine's inclusive cycles came from,
+ *  - exclusive cycles per mnemonic (e.g. push/pop for save_registers),
+ *  - the hottest instructions.
+ * FOLDED (-F) gets one line per call stack, for flamegraph.pl.
+ */
+
+namespace /* anonymous */ {
+
+	// Word addresses; the ATmega328p has 26 vectors of 2 words each
+	constexpr std::uint32_t vector_table_end = 26 * 2;
+
+	constexpr int key_pin = 5; // PINC5
+
+	constexpr const char* delay_symbol    = "cycles_wait_ms";
+	constexpr const char* discover_symbol = "topology_discover";
+
+	/**
+	 * EEPROM slot of topology.csm for chip type 0 (TOPOLOGY_CHIP_TYPE in
+	 * memtest4164.csm), holding what __topology_defaults sets: the magic,
+	 * struct topology, and the checksum that makes all bytes sum to 0. A copy
+	 * of the layout in topology.csm; Simulation::run fails if the firmware does
+	 * not accept it.
+	 */
+	std::vector<std::uint8_t> topology_slot() {
+		std::vector<std::uint8_t> slot{
+			0x64, // TOPOLOGY_MAGIC
+			0,    // chip_type
+			0,    // flags, nothing known
+			1,    // row_neighbour
+			1,    // col_neighbour
+			0,    // polarity_row
+			0,    // polarity_col
+			0,    // polarity_invert
+			0,    // retention_s
+		};
+		std::uint8_t sum = 0;
+		for(const auto byte : slot) {
+			sum += byte;
+		}
+		slot.push_back(-sum);
+		return slot;
+	}
+
+	bool is_call(std::uint16_t op) {
+		return (op & 0xfe0e) == 0x940e // call
+		    || (op & 0xf000) == 0xd000 // rcall
+		    || op == 0x9509            // icall
+		    || op == 0x9519;           // eicall
+	}
+
+
+	/**
+	 * Call stack entry: where the call (or interrupt) came from, and where it
+	 * went to.
+	 */
+	struct Frame {
+		std::uint32_t callsite;
+		std::uint32_t entry;
+
+		bool operator<(const Frame& other) const {
+			return std::tie(callsite, entry) < std::tie(other.callsite, other.entry);
+		}
+	};
+	using Stack = std::vector<Frame>;
+
+	struct Sample {
+		Stack         stack;
+		std::uint32_t pc;
+		std::uint64_t instructions;
+		std::uint64_t cycles;
+	};
+
+	/**
+	 * Cycles per address and call stack, and how often each call stack was
+	 * entered.
+	 *
+	 * Stored as text, addresses in hex (words), a stack as
+	 * CALLSITE>ENTRY;CALLSITE>ENTRY;... from the outermost frame, or '-':
+	 *   calls STACK COUNT
+	 *   pc    STACK PC INSTRUCTIONS CYCLES
+	 */
+	struct Profile {
+		std::map<Stack, std::uint64_t> calls;
+		std::vector<Sample>            samples;
+
+		void write(const std::string& file_name) const {
+			std::ofstream output{file_name};
+			output << "# profiler 1\n" << std::hex;
+			for(const auto& [stack, count] : calls) {
+				output << "calls " << format(stack) << " " << std::dec << count << std::hex << "\n";
+			}
+			for(const Sample& sample : samples) {
+				output << "pc " << format(sample.stack) << " " << sample.pc
+				       << std::dec << " " << sample.instructions << " " << sample.cycles << std::hex << "\n";
+			}
+			if(!output) {
+				throw std::runtime_error("error writing '" + file_name + "'.");
+			}
+		}
+
+		static Profile read(const std::string& file_name) {
+			std::ifstream input{file_name};
+			if(!input) {
+				throw std::runtime_error("error opening file '" + file_name + "'.");
+			}
+			Profile profile;
+			std::string line;
+			std::size_t line_number = 0;
+			while(std::getline(input, line)) {
+				++line_number;
+				std::istringstream fields{line};
+				std::string kind, stack;
+				fields >> kind >> stack;
+				if(kind.empty() || kind[0] == '#') {
+					continue;
+				}
+				if(kind == "calls") {
+					std::uint64_t count{};
+					if(fields >> count) {
+						profile.calls[parse(stack)] += count;
+						continue;
+					}
+				}
+				else if(kind == "pc") {
+					Sample sample{parse(stack), 0, 0, 0};
+					if(fields >> std::hex >> sample.pc >> std::dec >> sample.instructions >> sample.cycles) {
+						profile.samples.push_back(std::move(sample));
+						continue;
+					}
+				}
+				throw std::runtime_error(file_name + ":" + std::to_string(line_number) + ": invalid line");
+			}
+			return profile;
+		}
+
+	private:
+		static std::string format(const Stack& stack) {
+			if(stack.empty()) {
+				return "-";
+			}
+			std::stringstream ss;
+			ss << std::hex;
+			for(std::size_t i = 0; i < stack.size(); ++i) {
+				ss << (i ? ";" : "") << stack[i].callsite << ">" << stack[i].entry;
+			}
+			return ss.str();
+		}
+
+		static Stack parse(const std::string& text) {
+			Stack stack;
+			if(text == "-") {
+				return stack;
+			}
+			std::istringstream frames{text};
+			std::string frame;
+			while(std::getline(frames, frame, ';')) {
+				const std::size_t arrow = frame.find('>');
+				if(arrow == std::string::npos) {
+					throw std::runtime_error("invalid stack '" + text + "'");
+				}
+				stack.push_back({
+					std::uint32_t(std::stoul(frame.substr(0, arrow), nullptr, 16)),
+					std::uint32_t(std::stoul(frame.substr(arrow + 1), nullptr, 16))
+				});
+			}
+			return stack;
+		}
+	};
+
+
+	/**
+	 * Just enough of a 4164 on the memtest4164 pins (see main in
+	 * memtest4164.csm) for the tests to pass: the address is latched on the
+	 * falling edges of ~RAS and ~CAS, an early write (~WE low) stores Din, a
+	 * read drives Dout until ~CAS rises.
+	 */
+	class Dram {
+		public:
+			Dram(const Dram&) = delete;
+			Dram& operator=(const Dram&) = delete;
+
+			explicit Dram(avr_t* avr)
+			: m_avr{avr}
+			, m_bits(65536, 0)
+			, m_row{0}
+			{
+				m_dout = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), dout_pin);
+				avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), ras_pin), on_ras, this);
+				avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), cas_pin), on_cas, this);
+			}
+
+		private:
+			static constexpr int ras_pin  = 1;
+			static constexpr int we_pin   = 2;
+			static constexpr int cas_pin  = 3;
+			static constexpr int din_pin  = 4;
+			static constexpr int dout_pin = 0;
+			static constexpr int portc = 0x28; // data space
+			static constexpr int portd = 0x2b;
+
+			static void on_ras(avr_irq_t*, std::uint32_t value, void* param) {
+				Dram& dram = *static_cast<Dram*>(param);
+				if(!value) {
+					dram.m_row = dram.m_avr->data[portd];
+				}
+			}
+
+			static void on_cas(avr_irq_t*, std::uint32_t value, void* param) {
+				Dram& dram = *static_cast<Dram*>(param);
+				if(value) {
+					return;
+				}
+				const std::uint8_t control = dram.m_avr->data[portc];
+				std::uint8_t& bit = dram.m_bits[(dram.m_row << 8) | dram.m_avr->data[portd]];
+				if(!(control & (1 << we_pin))) {
+					bit = (control >> din_pin) & 1;
+				}
+				else {
+					avr_raise_irq(dram.m_dout, bit);
+				}
+			}
+
+			avr_t*                    m_avr;
+			avr_irq_t*                m_dout;
+			std::vector<std::uint8_t> m_bits;
+			std::uint32_t             m_row;
+	};
+
+
+	class Simulation {
+		public:
+			Simulation(const std::string& firmware, unsigned long f_cpu)
+			: m_avr{avr_make_mcu_by_name("atmega328p")}
+			{
+				if(!m_avr) {
+					throw std::runtime_error("simavr does not know the atmega328p");
+				}
+				avr_init(m_avr);
+				m_avr->frequency = f_cpu;
+
+				std::ifstream input{firmware, std::ios::binary};
+				if(!input) {
+					throw std::runtime_error("error opening file '" + firmware + "'.");
+				}
+				std::vector<std::uint8_t> code{std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{}};
+				avr_loadcode(m_avr, code.data(), code.size(), 0);
+
+				std::vector<std::uint8_t> slot = topology_slot();
+				avr_eeprom_desc_t eeprom{};
+				eeprom.ee     = slot.data();
+				eeprom.offset = 0;
+				eeprom.size   = slot.size();
+				avr_ioctl(m_avr, AVR_IOCTL_EEPROM_SET, &eeprom);
+
+				m_dram = std::make_unique<Dram>(m_avr);
+				m_key  = avr_io_getirq(m_avr, AVR_IOCTL_IOPORT_GETIRQ('C'), key_pin);
+				avr_raise_irq(m_key, 0); // held down through reset would rediscover the topology
+				m_nodes.push_back({0, {0, 0}, 0});
+			}
+
+			~Simulation() {
+				avr_terminate(m_avr);
+			}
+
+			Simulation(const Simulation&) = delete;
+			Simulation& operator=(const Simulation&) = delete;
+
+			/**
+			 * Runs until the program reaches `stop` (a word address), or for
+			 * at most `max_cycles`. The test key is pressed when the program
+			 * first reaches `key` (a word address), and the routine at `delay`
+			 * (a word address) returns right away. Reaching `discover` (a
+			 * word address) is an error, see topology_slot().
+			 */
+			void run(std::uint32_t key, std::uint32_t stop, std::uint32_t delay, std::uint32_t discover, std::uint64_t max_cycles) {
+				bool pressed = false;
+				while(m_avr->cycle < max_cycles) {
+					const std::uint32_t pc    = m_avr->pc / 2;
+					const std::uint64_t cycle = m_avr->cycle;
+					const std::uint32_t sp    = stack_pointer();
+					if(pc == stop) {
+						break;
+					}
+					if(pc == key && !pressed) {
+						avr_raise_irq(m_key, 1);
+						pressed = true;
+					}
+					if(pc == discover) {
+						throw std::runtime_error(std::string("the firmware reached ") + discover_symbol
+						                         + ", the EEPROM topology slot does not match topology.csm (see topology_slot())");
+					}
+					if(pc == delay) {
+						return_from_call();
+						continue;
+					}
+					const std::uint16_t op = m_avr->flash[2*pc] | (m_avr->flash[2*pc + 1] << 8);
+					const int state = avr_run(m_avr);
+					if(state == cpu_Done || state == cpu_Crashed) {
+						break;
+					}
+
+					Count& count = m_counts[(std::uint64_t(m_frames.empty() ? 0 : m_frames.back().node) << 32) | pc];
+					++count.instructions;
+					count.cycles += m_avr->cycle - cycle;
+
+					// A frame ends when its return address is popped, however that happens
+					const std::uint32_t new_pc = m_avr->pc / 2;
+					const std::uint32_t new_sp = stack_pointer();
+					while(!m_frames.empty() && new_sp > m_frames.back().sp) {
+						m_frames.pop_back();
+					}
+					// An interrupt returns to where the program was about to
+					// continue, which may be the entry of a routine just called
+					const bool interrupt = new_pc < vector_table_end && pc >= vector_table_end;
+					const std::uint32_t return_address = (m_avr->data[new_sp + 1] << 8) | m_avr->data[new_sp + 2];
+					if(is_call(op) && new_sp == sp - (interrupt ? 4 : 2)) {
+						enter(pc, interrupt ? return_address : new_pc, sp - 2);
+					}
+					if(interrupt) {
+						enter(return_address, new_pc, new_sp);
+					}
+				}
+			}
+
+			Profile profile() const {
+				Profile profile;
+				for(std::size_t node = 1; node < m_nodes.size(); ++node) {
+					profile.calls[stack(node)] += m_nodes[node].calls;
+				}
+				for(const auto& [key, count] : m_counts) {
+					profile.samples.push_back({stack(key >> 32), std::uint32_t(key), count.instructions, count.cycles});
+				}
+				return profile;
+			}
+
+		private:
+			struct Node {
+				std::size_t   parent;
+				Frame         frame;
+				std::uint64_t calls;
+			};
+			struct Active {
+				std::size_t   node;
+				std::uint32_t sp; // after pushing the return address
+			};
+			struct Count {
+				std::uint64_t instructions;
+				std::uint64_t cycles;
+			};
+
+			std::uint32_t stack_pointer() const {
+				return m_avr->data[R_SPL] | (m_avr->data[R_SPH] << 8);
+			}
+
+			// Does what a ret at the entry of the routine just called would
+			void return_from_call() {
+				const std::uint32_t sp = stack_pointer() + 2;
+				m_avr->pc = 2 * ((m_avr->data[sp - 1] << 8) | m_avr->data[sp]);
+				m_avr->data[R_SPL] = sp & 0xff;
+				m_avr->data[R_SPH] = sp >> 8;
+				while(!m_frames.empty() && sp > m_frames.back().sp) {
+					m_frames.pop_back();
+				}
+			}
+
+			void enter(std::uint32_t callsite, std::uint32_t entry, std::uint32_t sp) {
+				const std::size_t parent = m_frames.empty() ? 0 : m_frames.back().node;
+				const std::uint64_t key = (std::uint64_t(parent) << 32) | (callsite << 16) | entry;
+				auto it = m_children.find(key);
+				if(it == m_children.end()) {
+					it = m_children.emplace(key, m_nodes.size()).first;
+					m_nodes.push_back({parent, {callsite, entry}, 0});
+				}
+				++m_nodes[it->second].calls;
+				m_frames.push_back({it->second, sp});
+			}
+
+			Stack stack(std::size_t node) const {
+				Stack result;
+				for(; node; node = m_nodes[node].parent) {
+					result.push_back(m_nodes[node].frame);
+				}
+				std::reverse(result.begin(), result.end());
+				return result;
+			}
+
+			avr_t*                                       m_avr;
+			std::unique_ptr<Dram>                        m_dram;
+			avr_irq_t*                                   m_key;
+			std::vector<Node>                            m_nodes; // call tree, 0 is the root
+			std::unordered_map<std::uint64_t, std::size_t> m_children;
+			std::vector<Active>                          m_frames;
+			std::unordered_map<std::uint64_t, Count>     m_counts; // by node and pc
+	};
+
+
+	struct Instruction {
+		std::size_t   line{};     // in the listing
+		std::string   text;
+		std::string   mnemonic;
+		std::string   definition; // file:line of the enclosing DEF_LABELED, if any
+	};
+
+	class Listing {
+		public:
+			explicit Listing(const std::string& file_name) {
+				std::ifstream input{file_name};
+				if(!input) {
+					throw std::runtime_error("error opening file '" + file_name + "'.");
+				}
+				// C:000034 e0f0      ldi zh, 0x00 ; comment
+				const std::regex code_line{R"(^C:([0-9a-fA-F]+)((?:\s+[0-9a-fA-F]{4})+)\s+(\S.*)$)"};
+				const std::regex label_line{R"(^\s*([A-Za-z_][A-Za-z0-9_]*):(.*)$)"};
+				// see DEF_MARKER in utility_macros.csm
+				const std::regex begin_marker{R"(;\s*---\[\s*([A-Za-z_][A-Za-z0-9_]*)\s*\]---)"};
+				const std::regex end_marker{R"marker(;\s*-+\[\s*"([^"]*)":(\d+)\s*\]---)marker"};
+
+				std::vector<std::string> pending_labels;
+				std::vector<std::vector<std::uint32_t>> definitions; // open DEF_MARKERs
+				std::string line;
+				std::size_t line_number = 0;
+				while(std::getline(input, line)) {
+					++line_number;
+					std::smatch match;
+					if(std::regex_search(line, match, begin_marker)) {
+						m_routines.insert(match[1]);
+						definitions.emplace_back();
+						continue;
+					}
+					if(std::regex_search(line, match, end_marker)) {
+						if(!definitions.empty()) {
+							std::string file = match[1];
+							file = file.substr(file.find_last_of('/') + 1);
+							for(const std::uint32_t address : definitions.back()) {
+								m_instructions[address].definition = file + ":" + match[2].str();
+							}
+							definitions.pop_back();
+						}
+						continue;
+					}
+					const bool is_code = std::regex_match(line, match, code_line);
+					if(!is_code && line.rfind("C:", 0) == 0) {
+						continue;
+					}
+					std::string text = is_code ? match[3].str() : line;
+					std::smatch label;
+					while(std::regex_match(text, label, label_line)) {
+						pending_labels.push_back(label[1]);
+						text = label[2];
+					}
+					if(!is_code) {
+						continue;
+					}
+
+					const std::uint32_t address = std::stoul(match[1], nullptr, 16);
+					for(const auto& name : pending_labels) {
+						m_labels.emplace(address, name);
+					}
+					pending_labels.clear();
+
+					const std::size_t first = text.find_first_not_of(" \t");
+					text = first == std::string::npos ? "" : text.substr(first);
+					if(text.empty() || text[0] == '.' || text[0] == ';') {
+						// data (.db/.dw) in the code segment
+						continue;
+					}
+					Instruction& instruction = m_instructions[address];
+					instruction.line     = line_number;
+					instruction.text     = text;
+					instruction.mnemonic = text.substr(0, text.find_first_of(" \t;"));
+					std::transform(instruction.mnemonic.begin(), instruction.mnemonic.end(), instruction.mnemonic.begin(), [](unsigned char c) { return std::tolower(c); });
+					for(auto& open : definitions) {
+						open.push_back(address);
+					}
+
+					// Targets of call, rcall and jmp start a routine
+					std::istringstream words{match[2]};
+					std::vector<std::uint16_t> opcode;
+					std::string word;
+					while(words >> word) {
+						opcode.push_back(std::stoul(word, nullptr, 16));
+					}
+					if(((opcode[0] & 0xfe0e) == 0x940e || (opcode[0] & 0xfe0e) == 0x940c) && opcode.size() > 1) {
+						m_targets.insert((std::uint32_t(opcode[0] & 0x01f0) << 13) | (std::uint32_t(opcode[0] & 0x0001) << 16) | opcode[1]);
+					}
+					else if((opcode[0] & 0xf000) == 0xd000) {
+						const int k = (opcode[0] & 0x0800) ? int(opcode[0] & 0x0fff) - 0x1000 : int(opcode[0] & 0x0fff);
+						m_targets.insert(address + 1 + k);
+					}
+				}
+			}
+
+			/**
+			 * Makes `address` the start of a routine, e.g. because it was
+			 * called at run time.
+			 */
+			void add_routine(std::uint32_t address) {
+				m_targets.insert(address);
+			}
+
+			/**
+			 * Name of the routine `address` belongs to.
+			 */
+			std::string routine(std::uint32_t address) const {
+				if(address < vector_table_end) {
+					return "<vector " + std::to_string(address / 2) + ">";
+				}
+				const auto it = starts().upper_bound(address);
+				return it == starts().begin() ? to_hex<std::uint16_t>(address) : std::prev(it)->second;
+			}
+
+			/**
+			 * Address of a label, if there is one.
+			 */
+			std::optional<std::uint32_t> address_of(const std::string& label) const {
+				for(const auto& [address, name] : m_labels) {
+					if(name == label) {
+						return address;
+					}
+				}
+				return std::nullopt;
+			}
+
+			/**
+			 * Nearest label and offset, e.g. __cycles_read_done+2
+			 */
+			std::string location(std::uint32_t address) const {
+				auto it = m_labels.upper_bound(address);
+				if(it == m_labels.begin()) {
+					return to_hex<std::uint16_t>(address);
+				}
+				--it;
+				return it->second + (address != it->first ? "+" + std::to_string(address - it->first) : "");
+			}
+
+			const Instruction* at(std::uint32_t address) const {
+				const auto it = m_instructions.find(address);
+				return it == m_instructions.end() ? nullptr : &it->second;
+			}
+
+		private:
+			/**
+			 * Routine starts by address. A DEF_LABELED name is preferred if
+			 * there are several labels at a start.
+			 */
+			const std::map<std::uint32_t, std::string>& starts() const {
+				if(m_starts_valid) {
+					return m_starts;
+				}
+				m_starts.clear();
+				for(const auto& [address, name] : m_labels) {
+					// not the DEF_MARKERs around data, e.g. PRINTF_FORMAT
+					if(m_routines.count(name) && m_instructions.count(address)) {
+						m_starts.emplace(address, name);
+					}
+				}
+				for(const std::uint32_t address : m_targets) {
+					const auto label = m_labels.find(address);
+					m_starts.emplace(address, label != m_labels.end() ? label->second : "sub_" + to_hex<std::uint16_t>(address));
+				}
+				m_starts_valid = true;
+				return m_starts;
+			}
+
+			std::map<std::uint32_t, Instruction>          m_instructions;
+			std::multimap<std::uint32_t, std::string>     m_labels;
+			std::set<std::string>                         m_routines; // DEF_LABELED names
+			std::set<std::uint32_t>                       m_targets;
+			mutable std::map<std::uint32_t, std::string>  m_starts;
+			mutable bool                                  m_starts_valid{};
+	};
+
+
+	std::string percent(std::uint64_t part, std::uint64_t total) {
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(2) << (total ? 100.0 * part / total : 0.0);
+		return ss.str();
+	}
+
+	template<typename Map>
+	std::vector<typename Map::const_iterator> by_value(const Map& map, std::size_t top) {
+		std::vector<typename Map::const_iterator> result;
+		for(auto it = map.begin(); it != map.end(); ++it) {
+			result.push_back(it);
+		}
+		std::stable_sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a->second > b->second; });
+		if(result.size() > top) {
+			result.resize(top);
+		}
+		return result;
+	}
+
+
+	void report(const Profile& profile, Listing& listing, double f_cpu, std::size_t top, const std::string& folded_file) {
+		for(const auto& [stack, count] : profile.calls) {
+			for(const Frame& frame : stack) {
+				listing.add_routine(frame.entry);
+			}
+		}
+
+		std::uint64_t total = 0;
+		std::uint64_t instructions = 0;
+		std::map<std::string, std::uint64_t> exclusive;
+		std::map<std::string, std::uint64_t> inclusive;
+		std::map<std::string, std::uint64_t> calls;
+		std::map<std::string, std::map<std::string, std::uint64_t>> callers; // callee -> caller -> cycles
+		std::map<std::string, std::uint64_t> mnemonics;
+		std::map<std::uint32_t, std::pair<std::uint64_t, std::uint64_t>> addresses; // cycles, count
+		std::map<std::string, std::uint64_t> folded;
+
+		for(const auto& [stack, count] : profile.calls) {
+			calls[listing.routine(stack.back().entry)] += count;
+		}
+		for(const Sample& sample : profile.samples) {
+			total        += sample.cycles;
+			instructions += sample.instructions;
+
+			// The routine each frame was in when it called the next, and the
+			// routine executing
+			std::vector<std::string> chain;
+			for(const Frame& frame : sample.stack) {
+				chain.push_back(listing.routine(frame.callsite));
+			}
+			chain.push_back(listing.routine(sample.pc));
+
+			exclusive[chain.back()] += sample.cycles;
+			std::set<std::string> seen;
+			std::set<std::pair<std::string, std::string>> seen_edges;
+			for(std::size_t i = 0; i < chain.size(); ++i) {
+				if(seen.insert(chain[i]).second) {
+					inclusive[chain[i]] += sample.cycles;
+				}
+				if(i && chain[i] != chain[i - 1] && seen_edges.insert({chain[i - 1], chain[i]}).second) {
+					callers[chain[i]][chain[i - 1]] += sample.cycles;
+				}
+			}
+
+			const Instruction* instruction = listing.at(sample.pc);
+			mnemonics[instruction ? instruction->mnemonic : "?"] += sample.cycles;
+			addresses[sample.pc].first  += sample.cycles;
+			addresses[sample.pc].second += sample.instructions;
+
+			std::string name = chain.front();
+			for(std::size_t i = 1; i < chain.size(); ++i) {
+				if(chain[i] != chain[i - 1]) {
+					name += ";" + chain[i];
+				}
+			}
+			folded[name] += sample.cycles;
+		}
+
+		std::cout << total << " cycles (" << std::fixed << std::setprecision(3) << total / f_cpu << "s at "
+		          << f_cpu / 1e6 << "MHz), " << instructions << " instructions\n"
+		          << "Not included: the waiting of " << calls[delay_symbol] << " delays (" << delay_symbol
+		          << " returns at once)\n";
+
+		std::cout << "\nRoutines by inclusive cycles\n"
+		          << std::setw(14) << "inclusive" << std::setw(8) << "%"
+		          << std::setw(14) << "exclusive" << std::setw(8) << "%"
+		          << std::setw(10) << "calls" << "  routine\n";
+		const auto hot_routines = by_value(inclusive, top);
+		for(const auto& it : hot_routines) {
+			const std::string& routine = it->first;
+			std::cout << std::setw(14) << it->second << std::setw(8) << percent(it->second, total)
+			          << std::setw(14) << exclusive[routine] << std::setw(8) << percent(exclusive[routine], total)
+			          << std::setw(10) << calls[routine] << "  " << routine << "\n";
+		}
+
+		std::cout << "\nCallers (inclusive cycles of each routine above, by caller)\n";
+		for(const auto& it : hot_routines) {
+			const auto& by_caller = callers[it->first];
+			if(by_caller.empty()) {
+				continue;
+			}
+			std::cout << "  " << it->first << "\n";
+			for(const auto& caller : by_value(by_caller, top)) {
+				std::cout << std::setw(14) << caller->second << std::setw(8) << percent(caller->second, total)
+				          << "  <- " << caller->first << "\n";
+			}
+		}
+
+		std::cout << "\nExclusive cycles by mnemonic\n";
+		for(const auto& it : by_value(mnemonics, top)) {
+			std::cout << std::setw(14) << it->second << std::setw(8) << percent(it->second, total) << "  " << it->first << "\n";
+		}
+
+		std::map<std::uint32_t, std::uint64_t> address_cycles;
+		for(const auto& [address, counts] : addresses) {
+			address_cycles[address] = counts.first;
+		}
+		std::cout << "\nHot instructions\n"
+		          << std::setw(14) << "cycles" << std::setw(8) << "%" << std::setw(12) << "count"
+		          << "  address  location / listing line / definition\n";
+		for(const auto& it : by_value(address_cycles, top)) {
+			const Instruction* instruction = listing.at(it->first);
+			std::cout << std::setw(14) << it->second << std::setw(8) << percent(it->second, total)
+			          << std::setw(12) << addresses[it->first].second
+			          << "  " << to_hex<std::uint16_t>(it->first) << "  " << listing.location(it->first);
+			if(instruction) {
+				std::cout << " (line " << instruction->line;
+				if(!instruction->definition.empty()) {
+					std::cout << ", " << instruction->definition;
+				}
+				std::cout << ")  " << instruction->text;
+			}
+			std::cout << "\n";
+		}
+
+		if(!folded_file.empty()) {
+			std::ofstream output{folded_file};
+			for(const auto& [stack, cycles] : folded) {
+				output << stack << " " << cycles << "\n";
+			}
+			if(!output) {
+				throw std::runtime_error("error writing '" + folded_file + "'.");
+			}
+		}
+	}
+
+
+	void usage(const char* self) {
+		std::cerr << "usage: " << self << " [-f F_CPU] [-c CYCLES] [-s SYMBOL] [-o PROFILE] [-F FOLDED] [-n TOP] FIRMWARE LISTING\n"
+		          << "       " << self << " -r PROFILE [-f F_CPU] [-F FOLDED] [-n TOP] LISTING\n";
+	}
+
+} /* anonymous */
+
+
+int main(const int argc, const char* argv[]) try {
+	unsigned long f_cpu      = 16000000;
+	std::uint64_t max_cycles = std::numeric_limits<std::uint64_t>::max();
+	std::string   stop       = "_debug_break";
+	std::size_t   top        = 30;
+	std::string   profile_file;
+	std::string   folded_file;
+	bool          from_profile = false;
+	std::vector<std::string> files;
+	for(int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if(arg == "-f" && i + 1 < argc) {
+			f_cpu = std::stoul(argv[++i]);
+		}
+		else if(arg == "-c" && i + 1 < argc) {
+			max_cycles = std::stoull(argv[++i]);
+		}
+		else if(arg == "-s" && i + 1 < argc) {
+			stop = argv[++i];
+		}
+		else if(arg == "-n" && i + 1 < argc) {
+			top = std::stoul(argv[++i]);
+		}
+		else if((arg == "-o" || arg == "-r") && i + 1 < argc) {
+			from_profile = arg == "-r";
+			profile_file = argv[++i];
+		}
+		else if(arg == "-F" && i + 1 < argc) {
+			folded_file = argv[++i];
+		}
+		else if(arg[0] != '-') {
+			files.push_back(arg);
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(files.size() != (from_profile ? 1u : 2u)) {
+		usage(argv[0]);
+		return 1;
+	}
+	Listing listing{files.back()};
+
+	Profile profile;
+	if(from_profile) {
+		profile = Profile::read(profile_file);
+	}
+	else {
+		const auto stop_address = listing.address_of(stop);
+		if(!stop_address) {
+			throw std::runtime_error("symbol '" + stop + "' not found in '" + files.back() + "'.");
+		}
+		const auto key_address = listing.address_of("wait_for_key_press");
+		if(!key_address) {
+			throw std::runtime_error("symbol 'wait_for_key_press' not found in '" + files.back() + "'.");
+		}
+		const auto delay_address = listing.address_of(delay_symbol);
+		if(!delay_address) {
+			throw std::runtime_error(std::string("symbol '") + delay_symbol + "' not found in '" + files.back() + "'.");
+		}
+		const auto discover_address = listing.address_of(discover_symbol);
+		if(!discover_address) {
+			throw std::runtime_error(std::string("symbol '") + discover_symbol + "' not found in '" + files.back() + "'.");
+		}
+		Simulation simulation{files.front(), f_cpu};
+		simulation.run(*key_address, *stop_address, *delay_address, *discover_address, max_cycles);
+		profile = simulation.profile();
+		if(!profile_file.empty()) {
+			profile.write(profile_file);
+		}
+	}
+	report(profile, listing, f_cpu, top, folded_file);
+	return 0;
+}
+catch(const std::exception& e) {
+	std::cerr << "Fatal error: " << e.what() << std::endl;
+	return 1;
+}
@@ -0,0 +1,183 @@
+#include "results.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <boost/scope_exit.hpp>
+
+
+std::optional<std::size_t> result_payload_length(std::uint8_t type) {
+	// Must match __results_record_length_lookup in results.csm
+	switch(static_cast<ResultType>(type)) {
+		case ResultType::test_start:    return 2;
+		case ResultType::test_end:      return 3;
+		case ResultType::cycles:        return 5;
+		case ResultType::failure:       return 5;
+		case ResultType::socket_status: return 3;
+	}
+	return std::nullopt;
+}
+
+
+ResultRecord::ResultRecord(const std::uint8_t* frame)
+: m_frame{frame}
+{}
+
+ResultType ResultRecord::type() const {
+	return static_cast<ResultType>(m_frame[1]);
+}
+
+std::uint8_t ResultRecord::length() const {
+	return m_frame[2];
+}
+
+const std::uint8_t* ResultRecord::frame() const {
+	return m_frame;
+}
+
+std::size_t ResultRecord::frame_size() const {
+	return length() + 4u;
+}
+
+std::uint8_t ResultRecord::u8(std::size_t offset) const {
+	return m_frame[3 + offset];
+}
+
+std::uint16_t ResultRecord::u16(std::size_t offset) const {
+	return (u8(offset) << 8) | u8(offset + 1);
+}
+
+std::uint32_t ResultRecord::u32(std::size_t offset) const {
+	return (std::uint32_t(u16(offset)) << 16) | u16(offset + 2);
+}
+
+
+ResultDecoder::ResultDecoder()
+: m_fill{0}
+, m_skipped_bytes{0}
+, m_bad_frames{0}
+{
+	static_assert(sizeof(m_buffer) >= 2*result_max_frame_size, "room for a partial frame and a read");
+}
+
+std::uint8_t* ResultDecoder::read_buffer() {
+	return m_buffer.data() + m_fill;
+}
+
+std::size_t ResultDecoder::read_space() const {
+	return m_buffer.size() - m_fill;
+}
+
+std::size_t ResultDecoder::skipped_bytes() const {
+	return m_skipped_bytes;
+}
+
+std::size_t ResultDecoder::bad_frames() const {
+	return m_bad_frames;
+}
+
+
+std::uint8_t classify_failure(std::uint8_t expected, std::uint8_t actual) {
+	const std::uint8_t flipped = expected ^ actual;
+	std::uint8_t result = 0;
+	if((flipped & expected) && (flipped & ~expected)) {
+		result |= failure_class_mixed;
+	}
+	else if(flipped & expected) {
+		result |= failure_class_lost_ones;
+	}
+	else if(flipped) {
+		result |= failure_class_lost_zeros;
+	}
+	if(flipped) {
+		result |= (flipped & (flipped - 1)) ? failure_class_multi_bit : failure_class_single_bit;
+	}
+	return result;
+}
+
+const char* failure_class_name(std::size_t bit) {
+	static const char* const names[failure_class_count] = {
+		"lost-ones", "lost-zeros", "mixed", "single-bit", "multi-bit"
+	};
+	return bit < failure_class_count ? names[bit] : "?";
+}
+
+
+bool ChipSummary::passed() const {
+	return complete && tests_failed == 0 && failures == 0;
+}
+
+
+ResultLog::ResultLog(const std::string& file_name)
+: m_log{nullptr}
+, m_index{nullptr}
+, m_size{0}
+, m_next_chip{0}
+{
+	for(const ChipSummary& summary : read_index(file_name)) {
+		m_next_chip = std::max<std::uint32_t>(m_next_chip, summary.chip + 1);
+	}
+	m_log   = std::fopen(file_name.c_str(), "ab");
+	m_index = std::fopen((file_name + ".idx").c_str(), "ab");
+	if(!m_log || !m_index) {
+		if(m_log) {
+			std::fclose(m_log);
+		}
+		if(m_index) {
+			std::fclose(m_index);
+		}
+		throw std::runtime_error("error opening log '" + file_name + "'.");
+	}
+	std::fseek(m_log, 0, SEEK_END);
+	m_size = std::ftell(m_log);
+}
+
+ResultLog::~ResultLog() {
+	std::fclose(m_log);
+	std::fclose(m_index);
+}
+
+std::uint32_t ResultLog::next_chip() {
+	return m_next_chip++;
+}
+
+std::uint64_t ResultLog::size() const {
+	return m_size;
+}
+
+void ResultLog::append(std::uint64_t time_us, std::uint32_t chip, const ResultRecord& record) {
+	const LogEntry entry{time_us, chip, static_cast<std::uint16_t>(record.frame_size()), 0};
+	if(std::fwrite(&entry, sizeof(entry), 1, m_log) != 1
+	|| std::fwrite(record.frame(), record.frame_size(), 1, m_log) != 1) {
+		throw std::runtime_error("error writing log");
+	}
+	m_size += sizeof(entry) + record.frame_size();
+}
+
+void ResultLog::append(const ChipSummary& summary) {
+	if(std::fwrite(&summary, sizeof(summary), 1, m_index) != 1) {
+		throw std::runtime_error("error writing log index");
+	}
+}
+
+void ResultLog::flush() {
+	std::fflush(m_log);
+	std::fflush(m_index);
+}
+
+std::vector<ChipSummary> ResultLog::read_index(const std::string& file_name) {
+	std::vector<ChipSummary> result;
+	std::FILE* index = std::fopen((file_name + ".idx").c_str(), "rb");
+	if(!index) {
+		return result;
+	}
+	BOOST_SCOPE_EXIT(&index) {
+		std::fclose(index);
+	} BOOST_SCOPE_EXIT_END
+	std::fseek(index, 0, SEEK_END);
+	// A partially written summary at the end (e.g. full disk) is ignored
+	result.resize(std::ftell(index) / sizeof(ChipSummary));
+	std::fseek(index, 0, SEEK_SET);
+	if(std::fread(result.data(), sizeof(ChipSummary), result.size(), index) != result.size()) {
+		throw std::runtime_error("error reading log index of '" + file_name + "'.");
+	}
+	return result;
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Host side of the binary result records streamed by the firmware, see
+ * results.csm for the frame format and the record types.
+ */
+constexpr std::uint8_t result_sync = 0xa5;
+constexpr std::size_t  result_max_frame_size = 3 + 255 + 1; // sync, type, length, payload, checksum
+
+enum class ResultType : std::uint8_t {
+	test_start    = 0x01,
+	test_end      = 0x02,
+	cycles        = 0x03,
+	failure       = 0x04,
+	socket_status = 0x05,
+};
+
+/**
+ * Used in place of the test number in cycles records.
+ */
+constexpr std::uint8_t result_cycles_fill_pass    = 0xfd;
+constexpr std::uint8_t result_cycles_compare_pass = 0xfe;
+constexpr std::uint8_t result_cycles_refresh      = 0xff; // total since reset
+
+/**
+ * Payload length of a record type, or nothing if the type is unknown.
+ */
+std::optional<std::size_t> result_payload_length(std::uint8_t type);
+
+
+/**
+ * A single record. It points into the buffer it was decoded from, and is
+ * only valid until that buffer is read into again.
+ */
+class ResultRecord {
+	public:
+		ResultRecord(const std::uint8_t* frame);
+		ResultType          type() const;
+		std::uint8_t        length() const;
+		const std::uint8_t* frame() const;
+		std::size_t         frame_size() const;
+
+		std::uint8_t  u8(std::size_t offset) const;
+		std::uint16_t u16(std::size_t offset) const; // msb first, like the firmware sends them
+		std::uint32_t u32(std::size_t offset) const;
+
+	private:
+		const std::uint8_t* m_frame;
+};
+
+
+/**
+ * Incremental frame decoder for one input stream.
+ *
+ * Data is read straight into read_buffer(), and frames are decoded where they
+ * are. Only an incomplete frame at the end of a read is moved to the front of
+ * the buffer, so a record is never copied before it is complete.
+ */
+class ResultDecoder {
+	public:
+		ResultDecoder();
+
+		std::uint8_t* read_buffer();
+		std::size_t   read_space() const;
+
+		/**
+		 * Decodes the `n` bytes just read into read_buffer(), calling
+		 * `on_record(const ResultRecord&)` for every complete, valid frame.
+		 * Invalid frames are skipped by resynchronising on the next sync byte.
+		 */
+		template<typename F>
+		void commit(std::size_t n, F&& on_record);
+
+		std::size_t skipped_bytes() const;
+		std::size_t bad_frames() const;
+
+	private:
+		std::array<std::uint8_t, 4096> m_buffer;
+		std::size_t                    m_fill;
+		std::size_t                    m_skipped_bytes;
+		std::size_t                    m_bad_frames;
+};
+
+
+/**
+ * Failure classes, derived from the expected and actual value of a failed
+ * compare. Used as bits in ChipSummary::failure_classes.
+ */
+enum FailureClass : std::uint8_t {
+	failure_class_lost_ones   = 1<<0, // only 1s read back as 0
+	failure_class_lost_zeros  = 1<<1, // only 0s read back as 1
+	failure_class_mixed       = 1<<2, // both in a single byte
+	failure_class_single_bit  = 1<<3, // at least one failure with one flipped bit
+	failure_class_multi_bit   = 1<<4, // at least one failure with several flipped bits
+};
+constexpr std::size_t failure_class_count = 5;
+
+std::uint8_t classify_failure(std::uint8_t expected, std::uint8_t actual);
+const char*  failure_class_name(std::size_t bit);
+
+
+/**
+ * Summary of one chip (one run of the test sequence in one socket), as stored
+ * in the index of a ResultLog. Fixed size, so the index can be read as an
+ * array.
+ */
+struct ChipSummary {
+	char          lot[16];         // zero terminated
+	char          station[16];     // zero terminated, source the results came from
+	std::uint64_t log_offset;      // first log entry of this chip
+	std::uint64_t start_time_us;   // host time
+	std::uint64_t end_time_us;
+	std::uint32_t chip;            // sequence number in the log
+	std::uint32_t cycles;          // sum of the cycles records of all tests
+	std::uint32_t failed_tests;    // bit n-1 set if test n failed
+	std::uint16_t failures;        // failure records (saturating)
+	std::uint8_t  socket;
+	std::uint8_t  tests_run;
+	std::uint8_t  tests_failed;
+	std::uint8_t  failure_classes; // FailureClass bits
+	std::uint8_t  complete;        // socket_status was received
+	std::uint8_t  reserved[1];
+	std::uint32_t refresh_cycles;  // DRAM refresh interrupt, at the end of the run
+
+	bool passed() const;
+};
+static_assert(sizeof(ChipSummary) == 80, "ChipSummary is stored as-is in the index file");
+
+
+/**
+ * Header of every entry in the log, followed by the raw frame.
+ */
+struct LogEntry {
+	std::uint64_t time_us;
+	std::uint32_t chip;
+	std::uint16_t frame_size;
+	std::uint16_t reserved;
+};
+static_assert(sizeof(LogEntry) == 16, "LogEntry is stored as-is in the log file");
+
+
+/**
+ * Append-only result log.
+ *
+ * <name>     : LogEntry headers, each followed by the raw frame
+ * <name>.idx : ChipSummary per chip, appended when the chip is complete
+ *
+ * Both files are only ever appended to, so collecting into an existing log
+ * continues it. Lot queries only need to read the (small) index, the entries
+ * of a chip are found from its log_offset onwards.
+ */
+class ResultLog {
+	public:
+		ResultLog(const std::string& file_name);
+		~ResultLog();
+		ResultLog(const ResultLog&) = delete;
+		ResultLog& operator=(const ResultLog&) = delete;
+
+		std::uint32_t next_chip();
+		std::uint64_t size() const;
+
+		void append(std::uint64_t time_us, std::uint32_t chip, const ResultRecord& record);
+		void append(const ChipSummary& summary);
+		void flush();
+
+		static std::vector<ChipSummary> read_index(const std::string& file_name);
+
+	private:
+		std::FILE*    m_log;
+		std::FILE*    m_index;
+		std::uint64_t m_size;
+		std::uint32_t m_next_chip;
+};
+
+
+/******************************************************************************/
+
+
+template<typename F>
+void ResultDecoder::commit(std::size_t n, F&& on_record) {
+	m_fill += n;
+	std::size_t pos = 0;
+	// The smallest frame has no payload: sync, type, length, checksum
+	while(m_fill - pos >= 4) {
+		const std::uint8_t* frame = m_buffer.data() + pos;
+		if(frame[0] != result_sync) {
+			++pos;
+			++m_skipped_bytes;
+			continue;
+		}
+		// Check type and length first, so garbage doesn't stall decoding
+		// until a bogus length worth of bytes has arrived
+		const std::size_t size = frame[2] + 4u;
+		const std::optional<std::size_t> payload = result_payload_length(frame[1]);
+		const bool plausible = payload && *payload == frame[2];
+		if(plausible && m_fill - pos < size) {
+			break;
+		}
+		std::uint8_t sum = 0;
+		for(std::size_t i = 1; plausible && i < size; ++i) {
+			sum += frame[i];
+		}
+		if(!plausible || sum != 0) {
+			// Not a frame after all, or a damaged one: resync after this byte
+			++pos;
+			++m_bad_frames;
+			continue;
+		}
+		on_record(ResultRecord{frame});
+		pos += size;
+	}
+	std::memmove(m_buffer.data(), m_buffer.data() + pos, m_fill - pos);
+	m_fill -= pos;
+}